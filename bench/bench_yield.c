@@ -0,0 +1,65 @@
+/**
+ * @file bench_yield.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Yield latency between two tasks, with and without switching the
+ * signal mask (what every switch paid when coco used sigsetjmp(x, 1)), in
+ * both stack modes
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "coco.h"
+
+#define YIELDS 200000
+
+struct run {
+    const char *name;
+    enum coco_stack_mode mode;
+    int keepMask;
+};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void pinger(struct run *r) {
+    coco_keep_sigmask(r->keepMask);
+    for (int i = 0; i < YIELDS; ++i) {
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+void kernal() {
+    static struct run runs[] = {
+        {"copy, keep sigmask", COCO_STACK_COPY, 1},
+        {"copy", COCO_STACK_COPY, 0},
+        {"separate, keep sigmask", COCO_STACK_SEPARATE, 1},
+        {"separate", COCO_STACK_SEPARATE, 0},
+    };
+    coco_keep_sigmask(0);
+    for (size_t i = 0; i < sizeof runs / sizeof *runs; ++i) {
+        coco_set_stack_mode(runs[i].mode);
+        double start = now_ns();
+        int t1 = add_task((coroutine)pinger, &runs[i]);
+        int t2 = add_task((coroutine)pinger, &runs[i]);
+        coco_waitpid(t1, NULL, COCO_WNOOPT);
+        coco_waitpid(t2, NULL, COCO_WNOOPT);
+        // the kernal is parked in coco_waitpid, so only the two switch
+        double switches = 2.0 * YIELDS;
+        printf("%-24s %8.1f ns/yield\n", runs[i].name,
+               (now_ns() - start) / switches);
+    }
+    coco_exit(0);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,393 @@
+/**
+ * @file coco_bench.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Microbenchmarks of the scheduler's basic operations, printed as
+ * JSON so runs can be compared between releases. Every benchmark is run
+ * REPS times and reports its best and median time per operation.
+ *
+ * Usage: coco_bench [--quick] [name]  (--quick runs a few ops, as a smoke
+ * test; a name runs only the benchmarks whose name starts with it)
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "coco.h"
+#include "coco_channel.h"
+#include "pool.h"
+
+#define REPS 5
+#define FRAME_CHUNK 256 // Stack bytes per level of the yield benchmark
+
+INCLUDE_CHANNEL(int);
+INCLUDE_SIZED_CHANNEL(int, 0);
+INCLUDE_SIZED_CHANNEL(int, 1);
+
+static int quick;
+static const char *only;
+static int numResults;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief one benchmark: run() does ops operations and returns how long that
+ * took in ns
+ *
+ */
+struct bench {
+    const char *name;
+    const char *unit; // What one op is
+    uint64_t (*run)(long ops, long param);
+    long ops;
+    long param;        // Stack bytes, channel buffer size, ...
+    const char *paramName;
+    enum coco_stack_mode mode;
+};
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(struct bench *b) {
+    if (only != NULL && strncmp(b->name, only, strlen(only)) != 0) {
+        return;
+    }
+    long ops = quick ? 100 : b->ops;
+    double perOp[REPS];
+    coco_set_stack_mode(b->mode);
+    b->run(ops / 10 + 1, b->param); // warm up the task table and frame pool
+    for (int r = 0; r < REPS; ++r) {
+        perOp[r] = (double)b->run(ops, b->param) / ops;
+    }
+    qsort(perOp, REPS, sizeof *perOp, by_value);
+    printf("%s\n    {\"name\": \"%s\", \"mode\": \"%s\", \"%s\": %ld, "
+           "\"unit\": \"%s\", \"ops\": %ld, \"reps\": %d, "
+           "\"best_ns_per_op\": %.1f, \"median_ns_per_op\": %.1f}",
+           numResults++ ? "," : "", b->name,
+           b->mode == COCO_STACK_COPY       ? "copy"
+           : b->mode == COCO_STACK_SEPARATE ? "separate"
+                                            : "shared",
+           b->paramName, b->param, b->unit, ops, REPS, perOp[0],
+           perOp[REPS / 2]);
+    fflush(stdout);
+}
+
+/* yield round trip with a deep frame ------------------------------------- */
+
+static long yieldRounds;
+
+/**
+ * @brief grow the stack by about bytes, then yield back and forth
+ *
+ */
+static void __attribute__((noinline)) deep_yield(long bytes) {
+    volatile char chunk[FRAME_CHUNK];
+    chunk[0] = 0;
+    if (bytes > FRAME_CHUNK) {
+        deep_yield(bytes - FRAME_CHUNK);
+    } else {
+        for (long i = 0; i < yieldRounds; ++i) {
+            coco_yield();
+        }
+    }
+    (void)chunk[0];
+}
+
+static void yielder(void *arg) {
+    deep_yield((long)(intptr_t)arg);
+    coco_exit(0);
+}
+
+static uint64_t bench_yield(long ops, long bytes) {
+    yieldRounds = ops;
+    uint64_t start = now_ns();
+    int t1 = add_task(yielder, (void *)(intptr_t)bytes);
+    int t2 = add_task(yielder, (void *)(intptr_t)bytes);
+    // the kernal is parked here, so the two tasks only switch to each other
+    coco_waitpid(t1, NULL, COCO_WNOOPT);
+    coco_waitpid(t2, NULL, COCO_WNOOPT);
+    return now_ns() - start;
+}
+
+/* spawn, exit, reap ------------------------------------------------------- */
+
+static void nothing(void *arg) {
+    (void)arg;
+    coco_exit(0);
+}
+
+static uint64_t bench_spawn(long ops, long param) {
+    (void)param;
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; ++i) {
+        coco_waitpid(add_task(nothing, NULL), NULL, COCO_WNOOPT);
+    }
+    return now_ns() - start;
+}
+
+/* channel ping-pong ------------------------------------------------------- */
+
+static struct sized_channel(int, 0) pingU, pongU;
+static struct sized_channel(int, 1) pingB, pongB;
+
+struct pingpong {
+    struct channel(int) *ping, *pong;
+    long rounds;
+};
+
+static void ponger(void *arg) {
+    struct pingpong *p = arg;
+    int v;
+    for (long i = 0; i < p->rounds; ++i) {
+        extract(int)(p->ping, &v);
+        send(int)(p->pong, v);
+    }
+    coco_exit(0);
+}
+
+static void pinger(void *arg) {
+    struct pingpong *p = arg;
+    int v;
+    for (long i = 0; i < p->rounds; ++i) {
+        send(int)(p->ping, (int)i);
+        extract(int)(p->pong, &v);
+    }
+    coco_exit(0);
+}
+
+static uint64_t bench_channel(long ops, long buffered) {
+    static struct pingpong p;
+    if (buffered) {
+        init_channel(&pingB, 1);
+        init_channel(&pongB, 1);
+        p.ping = (struct channel(int) *)&pingB;
+        p.pong = (struct channel(int) *)&pongB;
+    } else {
+        init_channel(&pingU, 0);
+        init_channel(&pongU, 0);
+        p.ping = (struct channel(int) *)&pingU;
+        p.pong = (struct channel(int) *)&pongU;
+    }
+    p.rounds = ops;
+    uint64_t start = now_ns();
+    int t1 = add_task(ponger, &p);
+    int t2 = add_task(pinger, &p);
+    coco_waitpid(t2, NULL, COCO_WNOOPT);
+    coco_waitpid(t1, NULL, COCO_WNOOPT);
+    return now_ns() - start;
+}
+
+/* fork -------------------------------------------------------------------- */
+
+static uint64_t bench_fork(long ops, long param) {
+    (void)param;
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; ++i) {
+        int tid = coco_fork();
+        if (tid == 0) {
+            coco_exit(0);
+        }
+        coco_waitpid(tid, NULL, COCO_WNOOPT);
+    }
+    return now_ns() - start;
+}
+
+/* fan-out of tiny jobs: a task each, or a pool ----------------------------- */
+
+static long jobsRun;
+
+static void job(void *arg) {
+    (void)arg;
+    ++jobsRun;
+}
+
+static void job_task(void *arg) {
+    job(arg);
+    coco_exit(0);
+}
+
+static uint64_t bench_fanout_spawn(long ops, long fanout) {
+    int tids[64];
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i += fanout) {
+        for (long k = 0; k < fanout; ++k) {
+            tids[k] = add_task(job_task, NULL);
+        }
+        for (long k = 0; k < fanout; ++k) {
+            coco_waitpid(tids[k], NULL, COCO_WNOOPT);
+        }
+    }
+    return now_ns() - start;
+}
+
+static uint64_t bench_fanout_pool(long ops, long fanout) {
+    static struct coco_pool pool;
+    long long handles[64];
+    coco_pool_init(&pool, 4, 64);
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i += fanout) {
+        for (long k = 0; k < fanout; ++k) {
+            handles[k] = coco_pool_submit(&pool, job, NULL);
+        }
+        for (long k = 0; k < fanout; ++k) {
+            coco_pool_wait(&pool, handles[k]);
+        }
+    }
+    uint64_t ns = now_ns() - start;
+    coco_pool_destroy(&pool);
+    return ns;
+}
+
+/* scheduler passes over a big run queue ---------------------------------- */
+
+static volatile int stopRound;
+static long passRounds;
+
+static void round_yielder(void *arg) {
+    (void)arg;
+    for (long i = 0; i < passRounds; ++i) {
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+static void waiter(void *arg) {
+    (void)arg;
+    while (!stopRound) {
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+// ops task switches spread over tasks tasks
+static uint64_t bench_pass_yield(long ops, long tasks) {
+    static int tids[10000];
+    passRounds = ops / tasks > 0 ? ops / tasks : 1;
+    uint64_t start = now_ns();
+    for (long i = 0; i < tasks; ++i) {
+        tids[i] = add_task(round_yielder, NULL);
+    }
+    for (long i = 0; i < tasks; ++i) {
+        coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+    }
+    // per switch, with the spawns and reaps spread over them
+    return (now_ns() - start) * ops / (passRounds * tasks);
+}
+
+// ops passes over tasks stopped tasks the scheduler has to skip
+static uint64_t bench_pass_stopped(long ops, long tasks) {
+    static int tids[10000];
+    stopRound = 0;
+    for (long i = 0; i < tasks; ++i) {
+        tids[i] = add_task(waiter, NULL);
+        coco_kill(tids[i], COCO_SIGSTP);
+    }
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; ++i) {
+        coco_yield();
+    }
+    uint64_t ns = now_ns() - start;
+    stopRound = 1;
+    for (long i = 0; i < tasks; ++i) {
+        coco_kill(tids[i], COCO_SIGCONT);
+    }
+    for (long i = 0; i < tasks; ++i) {
+        coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+    }
+    return ns;
+}
+
+/* DPC dispatch ------------------------------------------------------------ */
+
+static long dpcsRun;
+
+static void dpc(void *arg) {
+    (void)arg;
+    ++dpcsRun;
+    coco_exit(0);
+}
+
+static uint64_t bench_dpc(long ops, long batch) {
+    dpcsRun = 0;
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i += batch) {
+        for (long k = 0; k < batch; ++k) {
+            add_dpc(dpc, NULL);
+        }
+        // the scheduler runs the DPCs before it gets back to us
+        coco_yield();
+    }
+    while (dpcsRun < ops / batch * batch) {
+        coco_yield();
+    }
+    return now_ns() - start;
+}
+
+void kernal() {
+    struct bench benches[] = {
+        {"yield", "round trip (2 yields)", bench_yield, 200000, 0,
+         "stack_bytes", COCO_STACK_COPY},
+        {"yield", "round trip (2 yields)", bench_yield, 200000, 1024,
+         "stack_bytes", COCO_STACK_COPY},
+        {"yield", "round trip (2 yields)", bench_yield, 100000, 4096,
+         "stack_bytes", COCO_STACK_COPY},
+        {"yield", "round trip (2 yields)", bench_yield, 50000, 16384,
+         "stack_bytes", COCO_STACK_COPY},
+        {"yield", "round trip (2 yields)", bench_yield, 200000, 0,
+         "stack_bytes", COCO_STACK_SEPARATE},
+        {"yield", "round trip (2 yields)", bench_yield, 200000, 16384,
+         "stack_bytes", COCO_STACK_SEPARATE},
+        {"spawn_exit_waitpid", "task", bench_spawn, 100000, 0, "param",
+         COCO_STACK_COPY},
+        {"spawn_exit_waitpid", "task", bench_spawn, 50000, 0, "param",
+         COCO_STACK_SEPARATE},
+        {"channel_pingpong", "round trip", bench_channel, 100000, 0,
+         "buffer", COCO_STACK_COPY},
+        {"channel_pingpong", "round trip", bench_channel, 100000, 1,
+         "buffer", COCO_STACK_COPY},
+        {"fork", "fork, child exit, waitpid", bench_fork, 50000, 0, "param",
+         COCO_STACK_COPY},
+        {"fanout_spawn", "job", bench_fanout_spawn, 100000, 10, "fanout",
+         COCO_STACK_COPY},
+        {"fanout_pool", "job", bench_fanout_pool, 100000, 10, "fanout",
+         COCO_STACK_COPY},
+        {"pass_yield", "task switch", bench_pass_yield, 200000, 10000,
+         "tasks", COCO_STACK_COPY},
+        {"pass_stopped", "pass", bench_pass_stopped, 2000, 10000, "tasks",
+         COCO_STACK_COPY},
+        {"dpc", "DPC added and run", bench_dpc, 100000, 1, "batch",
+         COCO_STACK_COPY},
+        {"dpc", "DPC added and run", bench_dpc, 100000, 64, "batch",
+         COCO_STACK_COPY},
+    };
+    printf("{\"benchmarks\": [");
+    for (size_t i = 0; i < sizeof benches / sizeof *benches; ++i) {
+        measure(&benches[i]);
+    }
+    printf("\n]}\n");
+    coco_exit(0);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else {
+            only = argv[i];
+        }
+    }
+    coco_start(kernal, NULL);
+}
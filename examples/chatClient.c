@@ -10,10 +10,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <poll.h>
 #include <errno.h>
 
 #include "coco.h"
+#include "reactor.h"
 
 #define MAXLINE 1024
 
@@ -42,39 +42,31 @@ struct host_port {
 void echo(int clientfd) {
     char buf[MAXLINE];
     while (1) {
-        coco_yield();
-        ssize_t n = recv(clientfd, buf, MAXLINE, MSG_DONTWAIT);
+        ssize_t n = coco_read(clientfd, buf, MAXLINE);
         if (n == 0) {
             break;
         }
-        if(n == -1) {
-            if(errno == EAGAIN) {
-                continue;
-            } else {
-                unix_error("recv error");
-            }
+        if (n == -1) {
+            unix_error("read error");
         }
-        write(fileno(stdout), buf, n);
+        coco_write(fileno(stdout), buf, n);
     }
     coco_exit(0);
 }
 
 void sendstdin(int clientfd) {
     char buf[MAXLINE];
-    struct pollfd fds[1];
-    fds[0].fd = fileno(stdin);
-    fds[0].events = POLLIN;
     while (1) {
-                coco_yield();
-        poll(fds, 1, 0);
-        if (!(fds[0].revents & POLLIN)) {
-            continue;
+        ssize_t n = coco_read(fileno(stdin), buf, MAXLINE);
+        if (n <= 0) {
+            break;
+        }
+        if (coco_write(clientfd, buf, n) < 0) {
+            unix_error("write error");
         }
-        ssize_t n = read(fileno(stdin), buf, MAXLINE);
-        n = write(clientfd, buf, n);
-
-        
     }
+    // no more input, let the server hang up
+    shutdown(clientfd, SHUT_WR);
     coco_exit(0);
 }
 
@@ -96,7 +88,7 @@ void kernal(struct host_port *p) {
     add_task(AS_COROUTINE(sendstdin), (void *)clientfd);
     coco_waitpid(tid, NULL, 0);
 
-    close(clientfd);
+    coco_close(clientfd);
     coco_exit(0);
 }
 
@@ -168,9 +160,9 @@ open_client(char *hostname, char *port)
 		 * Try connecting to the server with ai's addr and addrlen.
 		 * Break out of the loop if connect() succeeds.
 		 */
-		int err = connect(fd, ai->ai_addr, ai->ai_addrlen);
+		int err = coco_connect(fd, ai->ai_addr, ai->ai_addrlen);
 		if(err) {
-			printf("clientside err %dn", err);
+			printf("clientside err %d\n", err);
 		} else {
 			break;
 		}
@@ -180,7 +172,7 @@ open_client(char *hostname, char *port)
 		 * Connect() failed.  Close the descriptor and continue to
 		 * the next ai.
 		 */
-		if (close(fd) == -1)
+		if (coco_close(fd) == -1)
 			unix_error("close");
 	}
 
@@ -9,14 +9,15 @@
 
 #include <errno.h>
 #include <netdb.h>
-#include <poll.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "coco.h"
+#include "reactor.h"
 
 static int open_listen(int port);
 
@@ -41,32 +42,32 @@ enum app_state processCommand(int connfd, char *buf, ssize_t n,
                               enum app_state state) {
     if (n >= 4 && strncmp(buf, "exit", 4) == 0) {
         printf("server closing connection\n");
-        close(connfd);
+        coco_close(connfd);
         coco_exit(0);
     }
     if (n >= 4 && strncmp(buf, "echo", 4) == 0) {
-        write(connfd, "In Echo Mode\n", 13);
+        coco_write(connfd, "In Echo Mode\n", 13);
         return APP_STATE_ECHO;
     }
     if (n >= 4 && strncmp(buf, "help", 4) == 0) {
         // write(connfd, "Commands:\n\techo\n\texit\n", 24);
-        write(connfd,
-              "Commands:\n\techo - echo mode\n\texit - exit server\n\t"
-              "help - print this message\n",
-              75);
+        coco_write(connfd,
+                   "Commands:\n\techo - echo mode\n\texit - exit server\n\t"
+                   "help - print this message\n",
+                   75);
         return state;
     }
-    write(connfd, "Unknown Command\n", 16);
+    coco_write(connfd, "Unknown Command\n", 16);
     return state;
 }
 
 void writePrompt(int connfd, enum app_state state) {
     switch (state) {
     case APP_STATE_ECHO:
-        write(connfd, "echo> ", 6);
+        coco_write(connfd, "echo> ", 6);
         break;
     case APP_STATE_NONE:
-        write(connfd, "> ", 3);
+        coco_write(connfd, "> ", 3);
         break;
     }
 }
@@ -78,20 +79,16 @@ void handle(int connfd) {
     writePrompt(connfd, state);
 
     while (1) {
-        coco_yield();
-        n = recv(connfd, buf, MAXLINE, MSG_DONTWAIT);
+        n = coco_read(connfd, buf, MAXLINE);
 
         if (n == 0) {
             processCommand(connfd, "exit", 4, state);
             break;
         }
         if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                continue;
-            }
-            unix_error("recv error");
+            unix_error("read error");
         }
-                    printf("server received %zd bytes\n", n);
+        printf("server received %zd bytes\n", n);
 
         if (buf[0] == '$') {
             state = processCommand(connfd, buf + 1, n, state);
@@ -101,12 +98,13 @@ void handle(int connfd) {
 
         switch (state) {
         case APP_STATE_ECHO:
-            write(connfd, buf, n);
+            coco_write(connfd, buf, n);
 
             break;
         case APP_STATE_NONE:
-            write(connfd,
-                  "No Mode Selected\nRun '$help' for a list of commands\n", 54);
+            coco_write(connfd,
+                       "No Mode Selected\nRun '$help' for a list of commands\n",
+                       54);
             break;
         }
         writePrompt(connfd, state);
@@ -133,24 +131,17 @@ void kernal(int *port) {
     if (listenfd < 0)
         unix_error("open_listen error");
     while (true) {
-        coco_yield();
-        // zombs
         clientlen = sizeof(clientaddr);
         /*
          * Call Accept() to accept a pending connection request from
          * the client, and create a new file descriptor representing
          * the server's end of the connection.  Assign the new file
-         * descriptor to connfd.
+         * descriptor to connfd.  The task sleeps until one arrives.
          */
-        struct pollfd fds[1];
-        fds[0].fd = listenfd;
-        fds[0].events = POLLIN;
-        poll(fds, 1, 0);
-        if (!(fds[0].revents & POLLIN)) {
-            continue;
-        }
-
-        connfd = accept(listenfd, (struct sockaddr *)&clientaddr, &clientlen);
+        connfd =
+            coco_accept(listenfd, (struct sockaddr *)&clientaddr, &clientlen);
+        if (connfd < 0)
+            unix_error("accept error");
         // Use getnameinfo() to determine the client's host name.
         getnameinfo((struct sockaddr *)&clientaddr, clientlen, host_name,
                     NI_MAXHOST, NULL, 0, AI_NUMERICSERV | AI_ADDRCONFIG);
@@ -0,0 +1,82 @@
+/**
+ * @file example11_separate_stacks.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of tasks running on their own stacks
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coco.h"
+
+// deep enough that a copying task would save tens of KiB on every yield
+#define DEEP_BYTES (16 * 1024)
+
+int deep(int depth) {
+    volatile char buf[DEEP_BYTES / 4];
+    memset((char *)buf, depth, sizeof buf);
+    if (depth > 0) {
+        coco_yield();
+        int sum = deep(depth - 1);
+        coco_yield();
+        return sum + buf[depth];
+    }
+    coco_yield();
+    return buf[0];
+}
+
+void deep_task(int *out) {
+    *out = deep(4);
+    coco_exit(0);
+}
+
+void shallow_task(int *out) {
+    for (int i = 0; i < 10; ++i) {
+        ++*out;
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+void fork_task(int *out) {
+    int local = 7;
+    int tid = coco_fork();
+    coco_yield();
+    local += tid ? 1 : 2;
+    if (tid) {
+        coco_waitpid(tid, NULL, COCO_WNOOPT);
+        *out += local;
+    } else {
+        *out += local * 10;
+    }
+    coco_exit(0);
+}
+
+void kernal() {
+    static int deepOut, shallowOut, forkOut;
+
+    coco_set_stack_mode(COCO_STACK_SEPARATE);
+    int t1 = add_task((coroutine)deep_task, &deepOut);
+    int t3 = add_task((coroutine)fork_task, &forkOut);
+    // both modes can run side by side
+    coco_set_stack_mode(COCO_STACK_COPY);
+    int t2 = add_task((coroutine)shallow_task, &shallowOut);
+
+    coco_waitpid(t1, NULL, COCO_WNOOPT);
+    coco_waitpid(t2, NULL, COCO_WNOOPT);
+    coco_waitpid(t3, NULL, COCO_WNOOPT);
+    printf("%d %d %d\n", deepOut, shallowOut, forkOut);
+    if (deepOut != 0 + 1 + 2 + 3 + 4 || shallowOut != 10 || forkOut != 98) {
+        coco_exit(1);
+    }
+    coco_exit(0);
+}
+
+int main() { coco_start(kernal, NULL); }
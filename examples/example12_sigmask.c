@@ -0,0 +1,61 @@
+/**
+ * @file example12_sigmask.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of a task that keeps its own signal mask across switches
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coco.h"
+
+static bool blocked(int sig) {
+    sigset_t set;
+    sigprocmask(SIG_SETMASK, NULL, &set);
+    return sigismember(&set, sig);
+}
+
+static int failures = 0;
+
+void blocker() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    coco_keep_sigmask(1);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    for (int i = 0; i < 10; ++i) {
+        coco_yield();
+        // our mask comes back every time we are resumed
+        failures += !blocked(SIGUSR1);
+    }
+    coco_exit(0);
+}
+
+void plain() {
+    for (int i = 0; i < 10; ++i) {
+        coco_yield();
+        // and never leaks into tasks that don't keep one
+        failures += blocked(SIGUSR1);
+    }
+    coco_exit(0);
+}
+
+void kernal() {
+    int t1 = add_task((coroutine)blocker, NULL);
+    int t2 = add_task((coroutine)plain, NULL);
+    coco_waitpid(t1, NULL, COCO_WNOOPT);
+    coco_waitpid(t2, NULL, COCO_WNOOPT);
+    failures += blocked(SIGUSR1);
+    printf("%d failures\n", failures);
+    coco_exit(failures != 0);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,71 @@
+/**
+ * @file example13_timers.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of many sleeping tasks waking on wall clock deadlines
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "coco.h"
+
+#define SLEEPERS 200
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double woken[SLEEPERS]; // deadlines in the order they were met
+static int numWoken = 0;
+static int early = 0;
+
+void sleeper(uintptr_t ms) {
+    double start = now_ms();
+    yieldForMs(ms);
+    if (now_ms() - start < ms) {
+        ++early;
+    }
+    // a busy machine can start sleepers late, so order is by deadline
+    woken[numWoken++] = start + ms;
+    coco_exit(0);
+}
+
+void kernal() {
+    int tids[SLEEPERS];
+    // spawn in a scrambled order, they must still wake soonest due first
+    for (int i = 0; i < SLEEPERS; ++i) {
+        uintptr_t ms = 10 + (i * 37) % SLEEPERS;
+        tids[i] = add_task(AS_COROUTINE(sleeper), (void *)ms);
+    }
+    for (int i = 0; i < SLEEPERS; ++i) {
+        coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+    }
+    int unordered = 0;
+    for (int i = 1; i < SLEEPERS; ++i) {
+        // start is read just before the deadline is, allow for the gap
+        unordered += woken[i - 1] > woken[i] + 0.1;
+    }
+
+    // sleeping measures wall time even when nothing else is using the cpu
+    double start = now_ms();
+    yieldForMs(100);
+    double slept = now_ms() - start;
+
+    printf("%d woken, %d early, %d out of order, slept %.1f ms\n", numWoken,
+           early, unordered, slept);
+    coco_exit(numWoken != SLEEPERS || early || unordered || slept < 100 ||
+              slept > 1000);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,111 @@
+/**
+ * @file example14_wait_queues.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of tasks parking on channels, semaphores and waitgroups
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coco.h"
+#include "coco_channel.h"
+#include "semaphore.h"
+#include "waitgroup.h"
+
+INCLUDE_CHANNEL(int);
+INCLUDE_SIZED_CHANNEL(int, 0);
+INCLUDE_SIZED_CHANNEL(int, 4);
+
+#define PAIRS 50
+
+static struct sized_channel(int, 0) unbuf;
+static struct sized_channel(int, 4) buf;
+static struct sized_channel(int, 4) quit;
+static struct waitGroup wg;
+static coco_sem sem;
+static int received = 0;
+static int closedSeen = 0;
+static int arrived[PAIRS];
+static int numArrived = 0;
+static int order[PAIRS];
+static int numOrdered = 0;
+
+void writer(uintptr_t i) {
+    send(int)(&unbuf, i);
+    send(int)(&buf, i);
+    wg_done(&wg);
+    coco_exit(0);
+}
+
+void reader() {
+    int val;
+    extract(int)(&unbuf, &val);
+    received += val;
+    extract(int)(&buf, &val);
+    received += val;
+    wg_done(&wg);
+    // nobody ever sends again, close() has to wake us
+    if (extract(int)(&quit, &val) == kClosed) {
+        ++closedSeen;
+    }
+    coco_exit(0);
+}
+
+void sem_waiter(uintptr_t i) {
+    arrived[numArrived++] = i;
+    coco_sem_wait(&sem);
+    order[numOrdered++] = i;
+    coco_exit(0);
+}
+
+void kernal() {
+    int tids[3 * PAIRS];
+    init_channel(&unbuf, 0);
+    init_channel(&buf, 4);
+    init_channel(&quit, 4);
+    init_wg(&wg);
+    coco_sem_init(&sem, 0);
+    wg_add(&wg, 2 * PAIRS);
+
+    for (int i = 0; i < PAIRS; ++i) {
+        tids[i] = add_task((coroutine)reader, NULL);
+    }
+    for (int i = 0; i < PAIRS; ++i) {
+        tids[PAIRS + i] = add_task(AS_COROUTINE(writer), (void *)(uintptr_t)i);
+    }
+    wg_wait(&wg);
+    close(&quit);
+
+    for (int i = 0; i < PAIRS; ++i) {
+        tids[2 * PAIRS + i] =
+            add_task(AS_COROUTINE(sem_waiter), (void *)(uintptr_t)i);
+    }
+    coco_yield();
+    // waiters are woken one post at a time, longest waiting first
+    for (int i = 0; i < PAIRS; ++i) {
+        coco_sem_post(&sem);
+    }
+    for (int i = 0; i < 3 * PAIRS; ++i) {
+        coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+    }
+
+    int unordered = 0;
+    for (int i = 0; i < numOrdered; ++i) {
+        unordered += order[i] != arrived[i];
+    }
+    int expected = 2 * (PAIRS * (PAIRS - 1) / 2);
+    printf("received %d/%d, %d woken by close, %d/%d in order\n", received,
+           expected, closedSeen, numOrdered - unordered, PAIRS);
+    coco_exit(received != expected || closedSeen != PAIRS ||
+              numOrdered != PAIRS || unordered);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,54 @@
+/**
+ * @file example15_idle.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of the scheduler sleeping in the OS while every task waits
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "coco.h"
+#include "waitgroup.h"
+
+static struct waitGroup wg;
+
+void napper() {
+    for (int i = 0; i < 20; ++i) {
+        yieldForMs(10);
+    }
+    wg_done(&wg);
+    coco_exit(0);
+}
+
+void kernal() {
+    init_wg(&wg);
+    wg_add(&wg, 4);
+    clock_t cpuStart = clock();
+    for (int i = 0; i < 4; ++i) {
+        add_task((coroutine)napper, NULL);
+    }
+    // everyone is asleep or blocked for ~200ms
+    wg_wait(&wg);
+    double cpuMs = (clock() - cpuStart) * 1000.0 / CLOCKS_PER_SEC;
+
+    struct coco_idle_stats stats;
+    coco_idle_stats(&stats);
+    double idleMs = stats.idleNs / 1e6;
+    double avgLatencyUs =
+        stats.timerWakeups ? stats.latencyNs / 1e3 / stats.timerWakeups : 0;
+    printf("cpu %.1f ms, idle %.1f ms in %llu sleeps, wake up latency avg "
+           "%.1f us max %.1f us\n",
+           cpuMs, idleMs, stats.sleeps, avgLatencyUs,
+           stats.maxLatencyNs / 1e3);
+    coco_exit(cpuMs > 100 || idleMs < 150);
+}
+
+int main() { coco_start(kernal, NULL); }
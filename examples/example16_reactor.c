@@ -0,0 +1,199 @@
+/**
+ * @file example16_reactor.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of tasks parking on sockets and pipes instead of polling them
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "coco.h"
+#include "reactor.h"
+
+#define NUM_CLIENTS 8
+#define NUM_MESSAGES 50
+#define NUM_POLLERS 2000 // More than the ring's queues hold
+
+static struct sockaddr_in serverAddr;
+static int echoed;
+
+static double cpu_ms() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+}
+
+void echo_conn(int connfd) {
+    char buf[64];
+    ssize_t n;
+    while ((n = coco_read(connfd, buf, sizeof buf)) > 0) {
+        coco_write(connfd, buf, n);
+    }
+    coco_close(connfd);
+    coco_exit(0);
+}
+
+void server(int *listenfd) {
+    for (int i = 0; i < NUM_CLIENTS; ++i) {
+        int connfd = coco_accept(*listenfd, NULL, NULL);
+        if (connfd < 0) {
+            perror("accept");
+            coco_exit(1);
+        }
+        add_task(AS_COROUTINE(echo_conn), (void *)(uintptr_t)connfd);
+    }
+    coco_exit(0);
+}
+
+void client(void *id) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (coco_connect(fd, (struct sockaddr *)&serverAddr, sizeof serverAddr)) {
+        perror("connect");
+        coco_exit(1);
+    }
+    for (int i = 0; i < NUM_MESSAGES; ++i) {
+        char out[32], in[32];
+        int len = snprintf(out, sizeof out, "%d:%d", (int)(uintptr_t)id, i);
+        coco_write(fd, out, len);
+        int got = 0;
+        while (got < len) {
+            ssize_t n = coco_read(fd, in + got, len - got);
+            if (n <= 0) {
+                coco_exit(1);
+            }
+            got += n;
+        }
+        if (memcmp(in, out, len) != 0) {
+            coco_exit(1);
+        }
+        ++echoed;
+    }
+    coco_close(fd);
+    coco_exit(0);
+}
+
+void slow_writer(int *fd) {
+    yieldForMs(200);
+    coco_write(*fd, "late", 4);
+    coco_exit(0);
+}
+
+void slow_drainer(int *fd) {
+    static char sink[1 << 16];
+    yieldForMs(50);
+    read(*fd, sink, sizeof sink);
+    coco_exit(0);
+}
+
+static int pollers;
+
+void poller(int *fd) {
+    if (coco_wait_fd(*fd, COCO_FD_WRITE) == 0) {
+        ++pollers;
+    }
+    coco_exit(0);
+}
+
+void kernal() {
+    // tasks get pointers to these, so they can't live on a copied stack
+    static int listenfd, pipefd[2], fullfd[2];
+    listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof serverAddr;
+    if (bind(listenfd, (struct sockaddr *)&serverAddr, len) ||
+        listen(listenfd, NUM_CLIENTS) ||
+        getsockname(listenfd, (struct sockaddr *)&serverAddr, &len)) {
+        perror("listen");
+        coco_exit(1);
+    }
+
+    int tids[NUM_CLIENTS + 1];
+    tids[0] = add_task(AS_COROUTINE(server), &listenfd);
+    for (int i = 0; i < NUM_CLIENTS; ++i) {
+        tids[i + 1] = add_task(AS_COROUTINE(client), (void *)(uintptr_t)i);
+    }
+    for (int i = 0; i <= NUM_CLIENTS; ++i) {
+        int status;
+        coco_waitpid(tids[i], &status, COCO_WNOOPT);
+        if (status != 0) {
+            coco_exit(1);
+        }
+    }
+    struct coco_io_stats io;
+    coco_io_stats(&io);
+    printf("echoed %d messages, %llu I/O calls in %llu syscalls\n", echoed,
+           io.ops, io.syscalls);
+    // io_uring batches every task's submissions into one syscall per pass
+    char *engine = getenv("COCO_IO_ENGINE");
+    bool uring = engine != NULL && strcmp(engine, "uring") == 0;
+    if (uring && io.syscalls >= io.ops) {
+        coco_exit(1);
+    }
+
+    // a reader with nothing to read must sleep, not spin
+    if (pipe(pipefd)) {
+        coco_exit(1);
+    }
+    double before = cpu_ms();
+    add_task(AS_COROUTINE(slow_writer), &pipefd[1]);
+    char buf[8];
+    ssize_t n = coco_read(pipefd[0], buf, sizeof buf);
+    double cpu = cpu_ms() - before;
+    printf("read %zd bytes after waiting, cpu %.1f ms\n", n, cpu);
+    coco_close(pipefd[0]);
+    coco_close(pipefd[1]);
+
+    // waiting for either readiness wakes on the one that comes: a full pipe
+    // is never readable at its write end, but turns writable once drained
+    if (pipe(fullfd) || fcntl(fullfd[1], F_SETFL, O_NONBLOCK)) {
+        coco_exit(1);
+    }
+    while (write(fullfd[1], buf, sizeof buf) > 0) {
+    }
+    add_task(AS_COROUTINE(slow_drainer), &fullfd[0]);
+    int waited = coco_wait_fd(fullfd[1], COCO_FD_READ | COCO_FD_WRITE);
+    ssize_t more = write(fullfd[1], "x", 1);
+    printf("waited for read or write: %d, then wrote %zd byte\n", waited,
+           more);
+    // a burst of completions that overflows the completion queue still
+    // wakes everyone (epoll only reports the edge to whoever is parked)
+    if (uring) {
+        static int tids[NUM_POLLERS];
+        for (int i = 0; i < NUM_POLLERS; ++i) {
+            tids[i] = add_task(AS_COROUTINE(poller), &fullfd[1]);
+        }
+        for (int i = 0; i < NUM_POLLERS; ++i) {
+            coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+        }
+        printf("%d pollers woken\n", pollers);
+        if (pollers != NUM_POLLERS) {
+            coco_exit(1);
+        }
+    }
+    coco_close(fullfd[0]);
+    coco_close(fullfd[1]);
+    coco_close(listenfd);
+    if (echoed != NUM_CLIENTS * NUM_MESSAGES || n != 4 || cpu > 100 ||
+        waited != 0 || more != 1) {
+        coco_exit(1);
+    }
+    coco_exit(0);
+}
+
+int main() { coco_start(kernal, NULL); }
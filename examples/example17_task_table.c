@@ -0,0 +1,112 @@
+/**
+ * @file example17_task_table.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of the task table growing to its limit, and of reused slots
+ * getting new tids
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "coco.h"
+#include "coco_config.h"
+
+static int *tids;
+static long ran;
+
+void quick(void *) {
+    ++ran;
+    coco_exit(7);
+}
+
+void forker(int *out) {
+    int tid = coco_fork();
+    if (tid == 0) {
+        coco_exit(0);
+    }
+    *out = tid;
+    coco_exit(0);
+}
+
+void sleeper(void *) {
+    yieldForMs(10);
+    coco_exit(0);
+}
+
+void kernal() {
+    static int forked;
+    // a million tasks can't each have an mmap'd stack
+    coco_set_stack_mode(COCO_STACK_COPY);
+    tids = malloc(MAX_TASKS * sizeof *tids);
+
+    // fill the table, the kernal holds one slot and slot 0 is never used
+    int n = 0;
+    while ((tids[n] = add_task(quick, NULL)) != 0) {
+        ++n;
+    }
+    int full = coco_fork();
+    if (full == 0) {
+        coco_exit(0); // unreachable unless fork wrongly reported the child
+    }
+    printf("%d tasks, fork with a full table returned %d\n", n, full);
+    if (n != MAX_TASKS - 2 || full != -1) {
+        coco_exit(1);
+    }
+    for (int i = 0; i < n; ++i) {
+        int status;
+        if (coco_waitpid(tids[i], &status, COCO_WNOOPT) != tids[i] ||
+            status != 7) {
+            coco_exit(1);
+        }
+    }
+    printf("ran and reaped %ld\n", ran);
+
+    // a reaped tid is dead for good, even once its slot is reused
+    int stale = tids[0]; // the oldest freed slot is reused first
+    int fresh = add_task(sleeper, NULL);
+    printf("stale %#x, fresh %#x\n", stale, fresh);
+    if (fresh == stale ||
+        (fresh & (MAX_TASKS - 1)) != (stale & (MAX_TASKS - 1))) {
+        coco_exit(1);
+    }
+    if (coco_waitpid(stale, NULL, COCO_WNOHANG) != -1 ||
+        coco_kill(stale, COCO_SIGSTP) != -1 || coco_kill(fresh, COCO_SIGSTP) ||
+        coco_kill(fresh, COCO_SIGCONT)) {
+        coco_exit(1);
+    }
+    if (coco_waitpid(fresh, NULL, COCO_WNOOPT) != fresh ||
+        coco_waitpid(fresh, NULL, COCO_WNOHANG) != -1) {
+        coco_exit(1);
+    }
+
+    // were fresh's slot reused straight away, this many spawns would hand its
+    // tid to the live task below
+    for (int i = 1; i < 1 << (31 - TID_INDEX_BITS); ++i) {
+        int t = add_task(quick, NULL);
+        if (t == 0 || coco_waitpid(t, NULL, COCO_WNOOPT) != t) {
+            coco_exit(1);
+        }
+    }
+    int live = add_task(sleeper, NULL);
+    if (live == fresh || coco_kill(fresh, COCO_SIGSTP) != -1 ||
+        coco_waitpid(live, NULL, COCO_WNOOPT) != live) {
+        coco_exit(1);
+    }
+
+    // forks reuse slots the same way
+    int f = add_task((coroutine)forker, &forked);
+    coco_waitpid(f, NULL, COCO_WNOOPT);
+    if (forked <= 0 || coco_waitpid(forked, NULL, COCO_WNOOPT) != forked) {
+        coco_exit(1);
+    }
+    printf("forked %#x\n", forked);
+    free(tids);
+    coco_exit(0);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,91 @@
+/**
+ * @file example18_frame_pool.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of saved frames taking only as much memory as they need
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coco.h"
+
+#define NUM_SMALL 1000
+#define DEEP_BYTES (200 * 1024) // deeper than the largest size class
+
+static unsigned long long deepUsed, shallowUsed;
+
+void small(int *counter) {
+    for (int i = 0; i < 3; ++i) {
+        ++*counter;
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+int deep(int depth) {
+    volatile char buf[DEEP_BYTES / 8];
+    memset((char *)buf, depth, sizeof buf);
+    if (depth > 0) {
+        return deep(depth - 1) + buf[depth];
+    }
+    struct coco_frame_stats fs;
+    coco_yield();
+    coco_frame_stats(&fs);
+    deepUsed = fs.usedBytes;
+    return buf[0];
+}
+
+void deep_task(int *out) {
+    *out = deep(8);
+    coco_yield();
+    struct coco_frame_stats fs;
+    coco_frame_stats(&fs);
+    shallowUsed = fs.usedBytes;
+    coco_exit(0);
+}
+
+void kernal() {
+    static int counter, deepOut;
+    // frames are only saved when tasks share the scheduler stack
+    coco_set_stack_mode(COCO_STACK_COPY);
+
+    int tids[NUM_SMALL];
+    for (int i = 0; i < NUM_SMALL; ++i) {
+        tids[i] = add_task((coroutine)small, &counter);
+    }
+    // let them all park with a saved frame
+    coco_yield();
+    coco_yield();
+    struct coco_frame_stats fs;
+    coco_frame_stats(&fs);
+    printf("%d small tasks hold %llu bytes of frames, %llu each\n", NUM_SMALL,
+           fs.usedBytes, fs.usedBytes / NUM_SMALL);
+    for (int i = 0; i < NUM_SMALL; ++i) {
+        coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+    }
+    if (counter != 3 * NUM_SMALL || fs.usedBytes > NUM_SMALL * 1024) {
+        coco_exit(1);
+    }
+
+    int t = add_task((coroutine)deep_task, &deepOut);
+    coco_waitpid(t, NULL, COCO_WNOOPT);
+    printf("deep frames %llu bytes, back to %llu when shallow\n", deepUsed,
+           shallowUsed);
+    if (deepOut != 8 * 9 / 2 || deepUsed < 9 * DEEP_BYTES / 8 ||
+        shallowUsed > deepUsed / 16) {
+        coco_exit(1);
+    }
+
+    coco_frame_stats(&fs);
+    printf("%llu bytes in use, %llu cached, %llu peak\n", fs.usedBytes,
+           fs.cachedBytes, fs.peakUsedBytes);
+    coco_exit(0);
+}
+
+int main() { coco_start(kernal, NULL); }
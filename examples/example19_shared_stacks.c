@@ -0,0 +1,94 @@
+/**
+ * @file example19_shared_stacks.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of a producer and consumer switching without copying any
+ * frames because they run on different shared stacks
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "coco.h"
+#include "coco_channel.h"
+
+INCLUDE_CHANNEL(int);
+INCLUDE_SIZED_CHANNEL(int, 0);
+
+#define ROUNDS 1000
+
+static struct sized_channel(int, 0) handoff;
+static unsigned long long copied; // bytes copied in the steady state
+static int sum;
+
+static unsigned long long copied_so_far() {
+    struct coco_frame_stats fs;
+    coco_frame_stats(&fs);
+    return fs.copiedBytes;
+}
+
+void producer(void *) {
+    for (int i = 0; i < ROUNDS; ++i) {
+        send(int)(&handoff, i);
+    }
+    coco_exit(0);
+}
+
+void consumer(void *) {
+    int v;
+    extract(int)(&handoff, &v);
+    // both are running now, count only what the hand-offs copy
+    unsigned long long start = copied_so_far();
+    sum = v;
+    for (int i = 1; i < ROUNDS; ++i) {
+        extract(int)(&handoff, &v);
+        sum += v;
+    }
+    copied = copied_so_far() - start;
+    coco_exit(0);
+}
+
+/**
+ * @brief run the pair once
+ *
+ * @param[in] p tid of the producer
+ * @param[in] c tid of the consumer
+ */
+static void run_pair(const char *how, int p, int c) {
+    coco_waitpid(p, NULL, COCO_WNOOPT);
+    coco_waitpid(c, NULL, COCO_WNOOPT);
+    printf("%-16s %6.1f bytes copied per hand-off\n", how,
+           (double)copied / ROUNDS);
+    if (sum != ROUNDS * (ROUNDS - 1) / 2) {
+        coco_exit(1);
+    }
+}
+
+void kernal() {
+    init_channel(&handoff, 0);
+    if (coco_set_shared_stacks(2) != 0) {
+        coco_exit(1);
+    }
+
+    run_pair("different stacks", add_task_on_stack(producer, NULL, 0),
+             add_task_on_stack(consumer, NULL, 1));
+    unsigned long long apart = copied;
+
+    run_pair("same stack", add_task_on_stack(producer, NULL, 0),
+             add_task_on_stack(consumer, NULL, 0));
+    unsigned long long together = copied;
+
+    coco_set_stack_mode(COCO_STACK_COPY);
+    run_pair("copying", add_task(producer, NULL), add_task(consumer, NULL));
+
+    if (apart != 0 || together == 0 || copied == 0) {
+        coco_exit(1);
+    }
+    coco_exit(0);
+}
+
+int main() { coco_start(kernal, NULL); }
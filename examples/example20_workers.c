@@ -0,0 +1,144 @@
+/**
+ * @file example20_workers.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of tasks spread over several worker threads
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "coco.h"
+#include "coco_channel.h"
+#include "semaphore.h"
+#include "waitgroup.h"
+
+#define WORKERS 4
+#define NUM_TASKS 64
+#define ROUNDS 20
+
+INCLUDE_CHANNEL(int);
+INCLUDE_SIZED_CHANNEL(int, 8);
+INCLUDE_SIZED_CHANNEL(int, 0);
+
+static struct sized_channel(int, 8) results;
+static struct sized_channel(int, 0) pings;
+static struct waitGroup wg;
+static coco_sem sem;
+static int inCritical, maxInCritical;
+
+static pthread_t threads[NUM_TASKS];
+
+// enough work per round that the other workers get to steal
+static int spin(int seed) {
+    volatile int x = seed;
+    for (int i = 0; i < 200000; ++i) {
+        x = x * 31 + i;
+    }
+    return x & 1;
+}
+
+void worker_task(void *arg) {
+    int id = (int)(long)arg;
+    threads[id] = pthread_self();
+    int sum = 0;
+    for (int i = 0; i < ROUNDS; ++i) {
+        spin(i);
+        coco_yield();
+        // the same task keeps its thread once it has started
+        if (!pthread_equal(threads[id], pthread_self())) {
+            coco_exit(2);
+        }
+        ++sum;
+    }
+    coco_sem_wait(&sem);
+    coco_lock();
+    if (++inCritical > maxInCritical) {
+        maxInCritical = inCritical;
+    }
+    coco_unlock();
+    yieldForMs(1);
+    coco_lock();
+    --inCritical;
+    coco_unlock();
+    coco_sem_post(&sem);
+    send(int)(&results, sum);
+    wg_done(&wg);
+    coco_exit(0);
+}
+
+void ponger(void *arg) {
+    (void)arg;
+    int v;
+    while (extract(int)(&pings, &v) == kOkay) {
+        spin(v);
+    }
+    coco_exit(0);
+}
+
+void kernal() {
+    init_channel(&results, 8);
+    init_channel(&pings, 0);
+    init_wg(&wg);
+    coco_sem_init(&sem, 2);
+    wg_add(&wg, NUM_TASKS);
+
+    int tids[NUM_TASKS];
+    for (int i = 0; i < NUM_TASKS; ++i) {
+        tids[i] = add_task(worker_task, (void *)(long)i);
+    }
+    int pongTid = add_task(ponger, NULL);
+    // unbuffered hand offs between tasks that may sit on different workers
+    for (int i = 0; i < 100; ++i) {
+        send(int)(&pings, i);
+    }
+    close(&pings);
+
+    int total = 0;
+    for (int i = 0; i < NUM_TASKS; ++i) {
+        int v;
+        extract(int)(&results, &v);
+        total += v;
+    }
+    wg_wait(&wg);
+    int failed = 0;
+    for (int i = 0; i < NUM_TASKS; ++i) {
+        int status;
+        if (coco_waitpid(tids[i], &status, COCO_WNOOPT) != tids[i] ||
+            status != 0) {
+            ++failed;
+        }
+    }
+    coco_waitpid(pongTid, NULL, COCO_WNOOPT);
+
+    int distinct = 0;
+    for (int i = 0; i < NUM_TASKS; ++i) {
+        bool seen = false;
+        for (int j = 0; j < i; ++j) {
+            seen |= pthread_equal(threads[i], threads[j]);
+        }
+        distinct += !seen;
+    }
+    struct coco_worker_stats ws;
+    coco_worker_stats(&ws);
+    printf("total %d, failed %d, threads %d, steals %llu, max in sem %d\n",
+           total, failed, distinct, ws.steals, maxInCritical);
+    if (total != NUM_TASKS * ROUNDS || failed != 0 || ws.workers != WORKERS ||
+        distinct < 2 || ws.steals == 0 || maxInCritical > 2) {
+        coco_exit(1);
+    }
+    coco_exit(0);
+}
+
+int main() {
+    if (coco_set_workers(WORKERS) != 0 || coco_set_workers(0) == 0) {
+        return 1;
+    }
+    coco_start(kernal, NULL);
+}
@@ -0,0 +1,138 @@
+/**
+ * @file example21_shards.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of independent per-thread schedulers passing work around
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "coco.h"
+#include "coco_channel.h"
+#include "coco_config.h"
+#include "waitgroup.h"
+
+#define SHARDS 4
+#define RINGS 8
+#define HOPS 500
+#define CHURN (2 * TASK_SLAB_SIZE) // Enough for every shard to grow the table
+
+INCLUDE_CHANNEL(int);
+INCLUDE_SIZED_CHANNEL(int, 4);
+
+static struct waitGroup wg;
+static struct sized_channel(int, 4) reports;
+static pthread_t shardThread[SHARDS];
+static int hops, misplaced;
+
+// a token that hops from shard to shard, one task per hop
+void hop(void *arg) {
+    uintptr_t left = (uintptr_t)arg / SHARDS;
+    int shard = (uintptr_t)arg % SHARDS;
+    coco_lock();
+    ++hops;
+    // every shard is one thread, and tasks run where they were spawned
+    if (shard != coco_shard_id() ||
+        !pthread_equal(shardThread[shard], pthread_self())) {
+        ++misplaced;
+    }
+    coco_unlock();
+    coco_yield();
+    if (left == 0) {
+        wg_done(&wg);
+    } else {
+        int next = (shard + 1) % SHARDS;
+        coco_spawn_on(next, hop, (void *)((left - 1) * SHARDS + next));
+    }
+    coco_detach();
+    coco_exit(0);
+}
+
+void nop(void *arg) {
+    (void)arg;
+    coco_exit(0);
+}
+
+// spawn and reap on one shard while the others do the same, each from the
+// slots of its own slabs
+void churn(void *arg) {
+    (void)arg;
+    int bad = 0;
+    for (int i = 0; i < CHURN; ++i) {
+        int tid = add_task(nop, NULL);
+        bad += tid == 0 || coco_waitpid(tid, NULL, COCO_WNOOPT) != tid;
+    }
+    coco_exit(bad);
+}
+
+void whoami(void *arg) {
+    shardThread[coco_shard_id()] = pthread_self();
+    send(int)(&reports, (int)(uintptr_t)arg == coco_shard_id());
+    coco_exit(0);
+}
+
+void kernal() {
+    init_wg(&wg);
+    init_channel(&reports, 4);
+    if (coco_num_shards() != SHARDS || coco_shard_id() != 0) {
+        coco_exit(1);
+    }
+    int right = 0;
+    for (int i = 0; i < SHARDS; ++i) {
+        int tid = coco_spawn_on(i, whoami, (void *)(uintptr_t)i);
+        int ok;
+        extract(int)(&reports, &ok);
+        coco_waitpid(tid, NULL, COCO_WNOOPT);
+        right += ok;
+    }
+    if (coco_spawn_on(SHARDS, whoami, NULL) != 0) {
+        coco_exit(1);
+    }
+
+    wg_add(&wg, RINGS);
+    for (int r = 0; r < RINGS; ++r) {
+        int shard = r % SHARDS;
+        coco_spawn_on(shard, hop, (void *)(uintptr_t)(HOPS * SHARDS + shard));
+    }
+    wg_wait(&wg);
+
+    int churners[SHARDS], churnFailed = 0;
+    for (int i = 0; i < SHARDS; ++i) {
+        churners[i] = coco_spawn_on(i, churn, NULL);
+    }
+    for (int i = 0; i < SHARDS; ++i) {
+        int status;
+        churnFailed += coco_waitpid(churners[i], &status, COCO_WNOOPT) !=
+                           churners[i] ||
+                       status != 0;
+    }
+    struct coco_runtime_stats rt;
+    coco_runtime_stats(&rt);
+
+    struct coco_worker_stats ws;
+    coco_worker_stats(&ws);
+    printf("%d hops, %d misplaced, %d/%d shards right, %llu steals\n", hops,
+           misplaced, right, SHARDS, ws.steals);
+    printf("%d churned on each shard, %d failed, %llu live tasks\n", CHURN,
+           churnFailed, rt.liveTasks);
+    if (hops != RINGS * (HOPS + 1) || misplaced != 0 || right != SHARDS ||
+        ws.steals != 0 || churnFailed != 0 || rt.liveTasks != 1) {
+        coco_exit(1);
+    }
+    coco_exit(0);
+}
+
+int main() {
+    if (coco_set_shards(SHARDS) != 0) {
+        return 1;
+    }
+    coco_start(kernal, NULL);
+}
@@ -0,0 +1,116 @@
+/**
+ * @file example22_priorities.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of priority levels with and without aging
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "coco.h"
+
+#define TURNS 1000
+#define AGING 10
+
+static int urgentTurns, batchTurns, batchTurnsWhileUrgent;
+static int urgentDone;
+
+void urgent(void *arg) {
+    (void)arg;
+    for (int i = 0; i < TURNS; ++i) {
+        ++urgentTurns;
+        coco_yield();
+    }
+    urgentDone = 1;
+    coco_exit(0);
+}
+
+void batch(void *arg) {
+    (void)arg;
+    while (!urgentDone || batchTurns < TURNS) {
+        ++batchTurns;
+        batchTurnsWhileUrgent += !urgentDone;
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+// sleeping high priority work doesn't hold lower levels up
+void napper(void *arg) {
+    (void)arg;
+    yieldForMs(20);
+    coco_exit(0);
+}
+
+static int spinning;
+
+// a DPC that wakes up on every pass
+void spinner(void *arg) {
+    (void)arg;
+    while (spinning) {
+        yieldForMs(0);
+    }
+    coco_exit(0);
+}
+
+/**
+ * @brief run an urgent and a batch task side by side
+ *
+ * @return int the batch task's turns while the urgent one still ran
+ */
+int race() {
+    urgentTurns = batchTurns = batchTurnsWhileUrgent = urgentDone = 0;
+    int b = add_task_prio(batch, NULL, PRIO_LEVELS - 1);
+    int u = add_task_prio(urgent, NULL, 0);
+    coco_waitpid(u, NULL, COCO_WNOOPT);
+    coco_waitpid(b, NULL, COCO_WNOOPT);
+    return batchTurnsWhileUrgent;
+}
+
+void kernal() {
+    if (add_task_prio(batch, NULL, PRIO_LEVELS) != 0 ||
+        add_task_prio(batch, NULL, -1) != 0) {
+        coco_exit(1);
+    }
+    // the kernal waits on its own level, it must not starve the others
+    int strict = race();
+
+    coco_set_prio_aging(AGING);
+    int aged = race();
+    coco_set_prio_aging(0);
+
+    int n = add_task_prio(napper, NULL, 0);
+    int b = add_task_prio(batch, NULL, PRIO_LEVELS - 1);
+    urgentDone = 1;
+    batchTurns = 0;
+    coco_waitpid(b, NULL, COCO_WNOOPT);
+    coco_waitpid(n, NULL, COCO_WNOOPT);
+
+    // a stopped task on a higher level than the kernal's must not keep it
+    // from running, even while a DPC runs every pass
+    int held = add_task_prio(batch, NULL, 0);
+    coco_kill(held, COCO_SIGSTP);
+    spinning = 1;
+    add_dpc(spinner, NULL);
+    for (int i = 0; i < TURNS; ++i) {
+        coco_yield();
+    }
+    spinning = 0;
+    coco_kill(held, COCO_SIGCONT);
+    coco_waitpid(held, NULL, COCO_WNOOPT);
+
+    printf("batch turns while urgent ran: %d strict, %d with aging every %d\n",
+           strict, aged, AGING);
+    // strict: only the pass that started both; aged: about TURNS / AGING
+    if (strict > 1 || aged < TURNS / AGING / 2 || aged > 2 * TURNS / AGING) {
+        coco_exit(1);
+    }
+    coco_exit(0);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,74 @@
+/**
+ * @file example23_dpc_thread.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of DPCs running on a thread of their own
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "coco.h"
+#include "semaphore.h"
+
+#define DPCS 8
+
+static pthread_t mainThread;
+static coco_sem done;
+static int order[DPCS], numRun, onMain, followUpOnMain;
+
+void follow_up(void *arg) {
+    (void)arg;
+    followUpOnMain = pthread_equal(pthread_self(), mainThread);
+    coco_sem_post(&done);
+    coco_exit(0);
+}
+
+void dpc(void *arg) {
+    coco_lock();
+    order[numRun++] = (int)(uintptr_t)arg;
+    onMain += pthread_equal(pthread_self(), mainThread);
+    coco_unlock();
+    if ((uintptr_t)arg == 0) {
+        // DPCs can sleep, and what they spawn runs on the workers
+        yieldForMs(10);
+        add_task(follow_up, NULL);
+    }
+    coco_sem_post(&done);
+    coco_exit(0);
+}
+
+void kernal() {
+    mainThread = pthread_self();
+    coco_sem_init(&done, 0);
+    for (int i = 0; i < DPCS; ++i) {
+        add_dpc(dpc, (void *)(uintptr_t)i);
+    }
+    // each DPC and the follow up post once, from another thread
+    for (int i = 0; i < DPCS + 1; ++i) {
+        coco_sem_wait(&done);
+    }
+    int fifo = 1;
+    for (int i = 0; i < DPCS; ++i) {
+        fifo &= order[i] == i;
+    }
+    printf("%d DPCs, %d on the main thread, %s, follow up on main: %d\n",
+           numRun, onMain, fifo ? "in order" : "out of order", followUpOnMain);
+    if (numRun != DPCS || onMain != 0 || !fifo || !followUpOnMain) {
+        coco_exit(1);
+    }
+    coco_exit(0);
+}
+
+int main() {
+    if (coco_set_dpc_thread(1) != 0) {
+        return 1;
+    }
+    coco_start(kernal, NULL);
+}
@@ -0,0 +1,113 @@
+/**
+ * @file example24_signal_bridge.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of POSIX signals turned into coco signals and DPCs
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "coco.h"
+#include "semaphore.h"
+
+#define BURST 200 // More than SIGNAL_RING_SIZE, so some overflow the ring
+#define TICKS 3
+
+static coco_sem usr1Done, ticked;
+static int usr1Count, ticks;
+static volatile bool stop;
+
+void on_usr1(void *arg) {
+    (void)arg;
+    coco_lock();
+    bool last = ++usr1Count == BURST;
+    coco_unlock();
+    if (last) {
+        coco_sem_post(&usr1Done);
+    }
+    coco_exit(0);
+}
+
+void on_tick(void *arg) {
+    (void)arg;
+    coco_sem_post(&ticked);
+    coco_exit(0);
+}
+
+void on_sigint(void) { stop = true; }
+
+// a server loop that shuts down when the process gets SIGTERM
+void server(void *arg) {
+    (void)arg;
+    coco_sigaction(COCO_SIGINT, on_sigint);
+    int loops = 0;
+    while (!stop) {
+        yieldForMs(5);
+        ++loops;
+    }
+    coco_exit(loops > 0 ? 0 : 2);
+}
+
+// another thread that has nothing to do with coco sends the signal
+static void *terminator(void *arg) {
+    (void)arg;
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    usleep(20000);
+    kill(getpid(), SIGTERM);
+    return NULL;
+}
+
+void kernal() {
+    coco_sem_init(&usr1Done, 0);
+    coco_sem_init(&ticked, 0);
+
+    // every signal of a burst comes through as its own DPC
+    if (coco_bridge_signal_dpc(SIGUSR1, on_usr1, NULL) != 0) {
+        coco_exit(1);
+    }
+    for (int i = 0; i < BURST; ++i) {
+        raise(SIGUSR1);
+    }
+    coco_sem_wait(&usr1Done);
+
+    // interval timers become DPCs too
+    coco_bridge_signal_dpc(SIGALRM, on_tick, NULL);
+    struct itimerval every5ms = {{0, 5000}, {0, 5000}};
+    setitimer(ITIMER_REAL, &every5ms, NULL);
+    for (ticks = 0; ticks < TICKS; ++ticks) {
+        coco_sem_wait(&ticked);
+    }
+    setitimer(ITIMER_REAL, &(struct itimerval){0}, NULL);
+    coco_bridge_signal_dpc(SIGALRM, NULL, NULL);
+
+    // and a SIGTERM from outside becomes a COCO_SIGINT for the server
+    int tid = add_task(server, NULL);
+    if (coco_bridge_signal(SIGTERM, tid, COCO_SIGINT) != 0 ||
+        coco_bridge_signal(SIGKILL, tid, COCO_SIGINT) == 0) {
+        coco_exit(1);
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, terminator, NULL);
+    int status = -1;
+    coco_waitpid(tid, &status, COCO_WNOOPT);
+    pthread_join(thread, NULL);
+    coco_bridge_signal(SIGTERM, 0, COCO_SIGINT);
+
+    printf("%d/%d SIGUSR1 DPCs, %d ticks, server exited %d\n", usr1Count,
+           BURST, ticks, status);
+    coco_exit(usr1Count != BURST || ticks != TICKS || status != 0);
+}
+
+int main() { coco_start(kernal, NULL); }
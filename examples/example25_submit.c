@@ -0,0 +1,79 @@
+/**
+ * @file example25_submit.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of plain OS threads handing work to coco tasks
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "coco.h"
+#include "waitgroup.h"
+
+#define THREADS 4
+#define PER_THREAD 2000
+
+static struct waitGroup wg;
+static int handled[THREADS], early;
+
+// what a blocking client pool would hand back, one result per task
+void handle(void *arg) {
+    uintptr_t v = (uintptr_t)arg;
+    coco_lock();
+    ++handled[v % THREADS];
+    coco_unlock();
+    coco_yield();
+    wg_done(&wg);
+    coco_exit(0);
+}
+
+void before_start(void *arg) {
+    (void)arg;
+    early = 1;
+    coco_exit(0);
+}
+
+static void *client_pool(void *arg) {
+    uintptr_t id = (uintptr_t)arg;
+    for (uintptr_t i = 0; i < PER_THREAD; ++i) {
+        if (coco_submit_from_thread(handle, (void *)(i * THREADS + id)) != 0) {
+            abort();
+        }
+        // bursts with gaps, so the scheduler also has to be woken from idle
+        if (i % 500 == 0) {
+            usleep(2000);
+        }
+    }
+    return NULL;
+}
+
+void kernal() {
+    init_wg(&wg);
+    wg_add(&wg, THREADS * PER_THREAD);
+    pthread_t threads[THREADS];
+    for (uintptr_t i = 0; i < THREADS; ++i) {
+        pthread_create(&threads[i], NULL, client_pool, (void *)i);
+    }
+    wg_wait(&wg);
+    int total = 0;
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        total += handled[i];
+    }
+    printf("%d/%d handled, task submitted before coco_start ran: %d\n",
+           total, THREADS * PER_THREAD, early);
+    coco_exit(total != THREADS * PER_THREAD || !early);
+}
+
+int main() {
+    coco_submit_from_thread(before_start, NULL);
+    coco_start(kernal, NULL);
+}
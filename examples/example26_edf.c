@@ -0,0 +1,124 @@
+/**
+ * @file example26_edf.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of earliest-deadline-first tasks next to best-effort ones
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "coco.h"
+
+#define HOGS 4
+#define HOG_TURN_US 300
+#define PERIOD_US 20000
+#define JOBS 25
+#define PAIR_JOBS 5
+
+static volatile int done;
+static int hogTurns;
+static char finished[2 * PAIR_JOBS + 1];
+static int numFinished;
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static void spin_us(uint64_t us) {
+    uint64_t until = now_us() + us;
+    while (now_us() < until) {
+    }
+}
+
+// best-effort work that always has something to do
+void hog(void *arg) {
+    (void)arg;
+    while (!done) {
+        spin_us(HOG_TURN_US);
+        ++hogTurns;
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+// a control loop: a little work every period, due well before the next one
+void control(void *arg) {
+    (void)arg;
+    if (coco_set_edf(PERIOD_US, PERIOD_US * 3 / 4) != 0) {
+        coco_exit(2);
+    }
+    for (int i = 0; i < JOBS; ++i) {
+        spin_us(50);
+        coco_edf_wait();
+    }
+    coco_exit(0);
+}
+
+// two jobs released together: the one due first runs first, even when the
+// other one got going and only yields part way through
+void paired(void *arg) {
+    char name = (char)(uintptr_t)arg;
+    coco_set_edf(20000, name == 'S' ? 4000 : 16000);
+    coco_edf_wait(); // an empty first job, to line the releases up
+    for (int i = 0; i < PAIR_JOBS; ++i) {
+        for (int slice = 0; slice < (name == 'S' ? 1 : 10); ++slice) {
+            spin_us(100);
+            coco_yield();
+        }
+        finished[numFinished++] = name;
+        coco_edf_wait();
+    }
+    coco_set_edf(0, 0);
+    coco_yield(); // and best effort again
+    coco_exit(0);
+}
+
+void kernal() {
+    int hogs[HOGS];
+    for (int i = 0; i < HOGS; ++i) {
+        hogs[i] = add_task(hog, NULL);
+    }
+    int tid = add_task(control, NULL);
+    struct coco_edf_stats stats;
+    // it exits after its last job; its stats last until it is reaped
+    while (coco_edf_stats(tid, &stats) == 0 && stats.jobs < JOBS) {
+        yieldForMs(10);
+    }
+    done = 1;
+    int status;
+    coco_waitpid(tid, &status, COCO_WNOOPT);
+    for (int i = 0; i < HOGS; ++i) {
+        coco_waitpid(hogs[i], NULL, COCO_WNOOPT);
+    }
+    printf("control loop: %llu jobs, %llu missed, worst %llu us late; "
+           "%d best-effort turns\n",
+           stats.jobs, stats.misses, stats.maxLatenessNs / 1000, hogTurns);
+
+    int l = add_task(paired, (void *)(uintptr_t)'L');
+    int s = add_task(paired, (void *)(uintptr_t)'S');
+    coco_waitpid(l, NULL, COCO_WNOOPT);
+    coco_waitpid(s, NULL, COCO_WNOOPT);
+    printf("finish order: %s\n", finished);
+    int wrongOrder = 0;
+    for (int i = 0; i < PAIR_JOBS; ++i) {
+        wrongOrder += finished[2 * i] != 'S' || finished[2 * i + 1] != 'L';
+    }
+
+    if (coco_set_edf(1000, 2000) == 0 || coco_edf_stats(tid, &stats) == 0) {
+        coco_exit(1);
+    }
+    // a loaded machine may miss the odd deadline, not most of them
+    coco_exit(status != 0 || stats.jobs != JOBS || stats.misses > JOBS / 5 ||
+              hogTurns == 0 || wrongOrder != 0);
+}
+
+int main() { coco_start(kernal, NULL); }
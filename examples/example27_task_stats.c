@@ -0,0 +1,128 @@
+/**
+ * @file example27_task_stats.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of per-task counters and the runtime snapshot
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "coco.h"
+#include "semaphore.h"
+#include "waitgroup.h"
+
+#define TURNS 5
+#define BUSY_TURN_US 2000
+#define DEEP_BYTES 8192
+
+static struct waitGroup wg;
+static coco_sem release;
+
+static void spin_us(uint64_t us) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t until = (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000 + us;
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    } while ((uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000 < until);
+}
+
+// stay around until the kernal has looked at the counters
+static void finish() {
+    wg_done(&wg);
+    coco_sem_wait(&release);
+    coco_exit(0);
+}
+
+void busy(void *arg) {
+    (void)arg;
+    for (int i = 0; i < TURNS; ++i) {
+        spin_us(BUSY_TURN_US);
+        coco_yield();
+    }
+    finish();
+}
+
+void light(void *arg) {
+    (void)arg;
+    for (int i = 0; i < TURNS; ++i) {
+        coco_yield();
+    }
+    finish();
+}
+
+void deep(void *arg) {
+    (void)arg;
+    volatile char big[DEEP_BYTES];
+    for (int i = 0; i < TURNS; ++i) {
+        big[i * 1000] = i;
+        coco_yield();
+        (void)big[i * 1000];
+    }
+    finish();
+}
+
+static void print(const char *name, struct coco_task_stats *s) {
+    printf("%-6s %3llu resumes, %6llu us running, %6llu us ready, %6llu B "
+           "copied, %5llu B peak frame\n",
+           name, s->resumes, s->runNs / 1000, s->readyNs / 1000,
+           s->copiedBytes, s->peakFrameBytes);
+}
+
+void kernal() {
+    init_wg(&wg);
+    coco_sem_init(&release, 0);
+    coroutine funcs[] = {busy, light, deep};
+    const char *names[] = {"busy", "light", "deep"};
+    int tids[3];
+    wg_add(&wg, 3);
+    for (int i = 0; i < 3; ++i) {
+        tids[i] = add_task(funcs[i], NULL);
+    }
+    wg_wait(&wg);
+
+    struct coco_task_stats s[3];
+    int failed = 0;
+    for (int i = 0; i < 3; ++i) {
+        failed |= coco_task_stats(tids[i], &s[i]) != 0;
+        print(names[i], &s[i]);
+        // the first switch to it plus one per yield so far
+        failed |= s[i].resumes != TURNS + 1;
+    }
+    uint64_t busyNs = TURNS * BUSY_TURN_US * 1000ull;
+    // light waited on busy every pass, and ran for a sliver of it
+    failed |= s[0].runNs < busyNs * 9 / 10 || s[1].readyNs < busyNs / 2 ||
+              s[1].runNs > s[0].runNs / 10;
+    failed |= s[2].peakFrameBytes < DEEP_BYTES ||
+              s[2].peakFrameBytes < 2 * s[1].peakFrameBytes;
+
+    struct coco_runtime_stats rt;
+    coco_runtime_stats(&rt);
+    printf("%llu live tasks, %llu resumes, %llu us running, %llu B copied\n",
+           rt.liveTasks, rt.tasks.resumes, rt.tasks.runNs / 1000,
+           rt.tasks.copiedBytes);
+    failed |= rt.liveTasks != 4 || rt.tasks.resumes < 3 * (TURNS + 1) ||
+              rt.tasks.runNs < s[0].runNs || rt.workers.workers < 1;
+
+    for (int i = 0; i < 3; ++i) {
+        coco_sem_post(&release);
+    }
+    for (int i = 0; i < 3; ++i) {
+        coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+    }
+    // counters of reaped tasks still count in the totals
+    struct coco_runtime_stats after;
+    coco_runtime_stats(&after);
+    failed |= coco_task_stats(tids[0], &s[0]) == 0 ||
+              after.liveTasks != 1 || after.tasks.resumes < rt.tasks.resumes;
+    coco_exit(failed);
+}
+
+int main() { coco_start(kernal, NULL); }
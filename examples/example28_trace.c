@@ -0,0 +1,122 @@
+/**
+ * @file example28_trace.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of a scheduling trace written for Perfetto/chrome://tracing
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coco.h"
+#include "coco_channel.h"
+
+INCLUDE_CHANNEL(int);
+INCLUDE_SIZED_CHANNEL(int, 0);
+
+#define ITEMS 20
+
+static struct sized_channel(int, 0) items;
+
+void producer(void *arg) {
+    (void)arg;
+    for (int i = 0; i < ITEMS; ++i) {
+        send(int)(&items, i);
+    }
+    close(&items);
+    coco_exit(0);
+}
+
+void consumer(void *arg) {
+    (void)arg;
+    int v;
+    while (extract(int)(&items, &v) == kOkay) {
+        yieldForMs(1);
+    }
+    coco_exit(0);
+}
+
+void dpc(void *arg) {
+    (void)arg;
+    coco_exit(0);
+}
+
+static volatile int stop;
+
+void on_sigint(void) { stop = 1; }
+
+void idler(void *arg) {
+    (void)arg;
+    coco_sigaction(COCO_SIGINT, on_sigint);
+    for (int i = 0; i < 10; ++i) {
+        coco_yield();
+    }
+    while (!stop) {
+        yieldForMs(1);
+    }
+    coco_exit(0);
+}
+
+/**
+ * @brief count the occurrences of a string in a file's contents
+ *
+ */
+static int count(const char *text, const char *what) {
+    int n = 0;
+    for (const char *p = text; (p = strstr(p, what)) != NULL;
+         p += strlen(what)) {
+        ++n;
+    }
+    return n;
+}
+
+void kernal() {
+    init_channel(&items, 0);
+    int p = add_task(producer, NULL);
+    int c = add_task(consumer, NULL);
+    add_dpc(dpc, NULL);
+    int i = add_task(idler, NULL);
+    coco_waitpid(p, NULL, COCO_WNOOPT);
+    coco_waitpid(c, NULL, COCO_WNOOPT);
+    coco_kill(i, COCO_SIGINT);
+    coco_waitpid(i, NULL, COCO_WNOOPT);
+
+    const char *path = "example28_trace.json";
+    if (coco_trace_flush(path) != 0) {
+        coco_exit(1);
+    }
+    FILE *f = fopen(path, "r");
+    static char text[1 << 22];
+    size_t len = fread(text, 1, sizeof text - 1, f);
+    fclose(f);
+    text[len] = '\0';
+
+    int begins = count(text, "\"ph\":\"B\"");
+    int ends = count(text, "\"ph\":\"E\"");
+    int kinds[] = {count(text, "\"name\":\"spawn"),
+                   count(text, "\"name\":\"wake"),
+                   count(text, "\"name\":\"dpc"),
+                   count(text, "\"name\":\"kill"),
+                   count(text, "\"out\":\"yield\""),
+                   count(text, "\"out\":\"sleep\""),
+                   count(text, "\"out\":\"block\""),
+                   count(text, "\"out\":\"exit\"")};
+    printf("%zu bytes of trace, %d slices (%d ends), spawn %d, wake %d, "
+           "dpc %d, kill %d, yield %d, sleep %d, block %d, exit %d\n",
+           len, begins, ends, kinds[0], kinds[1], kinds[2], kinds[3], kinds[4],
+           kinds[5], kinds[6], kinds[7]);
+    int failed = strncmp(text, "{\"displayTimeUnit\"", 18) != 0 ||
+                 strcmp(text + len - 4, "\n]}\n") != 0 || begins != ends;
+    for (size_t k = 0; k < sizeof kinds / sizeof *kinds; ++k) {
+        failed |= kinds[k] == 0;
+    }
+    remove(path);
+    coco_exit(failed);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,106 @@
+/**
+ * @file example29_frame_report.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of the stack-frame report, to size frames from
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "coco.h"
+
+#define TASKS 8
+#define TURNS 3
+#define DEEP_BYTES 12000
+
+void shallow(void *arg) {
+    (void)arg;
+    for (int i = 0; i < TURNS; ++i) {
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+void deep(void *arg) {
+    (void)arg;
+    volatile char big[DEEP_BYTES];
+    for (int i = 0; i < TURNS; ++i) {
+        big[i * 4000] = i;
+        coco_yield();
+        (void)big[i * 4000];
+    }
+    coco_exit(0);
+}
+
+/**
+ * @brief find a function's line in the report
+ *
+ * @return int 0, or -1 if it isn't there
+ */
+static int find(FILE *f, const char *name, unsigned long long *tasks,
+                size_t *peak, size_t *budget) {
+    char line[256], func[128];
+    size_t median;
+    rewind(f);
+    while (fgets(line, sizeof line, f) != NULL) {
+        if (sscanf(line, "%127s %llu %zu %zu %zu", func, tasks, &median, peak,
+                   budget) == 5 &&
+            strcmp(func, name) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void kernal() {
+    int tids[2 * TASKS];
+    for (int i = 0; i < TASKS; ++i) {
+        tids[2 * i] = add_task(shallow, NULL);
+        tids[2 * i + 1] = add_task(deep, NULL);
+    }
+    // half of them reaped, half still around when the report is written
+    for (int i = 0; i < TASKS; ++i) {
+        coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+    }
+
+    char path[] = "/tmp/coco_framesXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || coco_frame_report(path) != 0) {
+        coco_exit(2);
+    }
+    FILE *f = fdopen(fd, "r");
+    char line[256];
+    while (fgets(line, sizeof line, f) != NULL) {
+        fputs(line, stdout);
+    }
+    unsigned long long shallowTasks, deepTasks;
+    size_t shallowPeak, deepPeak, shallowBudget, deepBudget;
+    int failed = find(f, "shallow", &shallowTasks, &shallowPeak,
+                      &shallowBudget) != 0 ||
+                 find(f, "deep", &deepTasks, &deepPeak, &deepBudget) != 0;
+    fclose(f);
+    unlink(path);
+    if (failed) {
+        coco_exit(1);
+    }
+    // every task has run by now: the reaped ones exited, the rest yielded
+    failed |= shallowTasks != TASKS || deepTasks != TASKS;
+    failed |= deepPeak < DEEP_BYTES || shallowPeak >= deepPeak;
+    // budgets leave room above the peak, and are no bigger than they must
+    failed |= deepBudget < deepPeak + deepPeak / 4 ||
+              shallowBudget < shallowPeak + shallowPeak / 4 ||
+              shallowBudget >= deepBudget;
+    for (int i = TASKS; i < 2 * TASKS; ++i) {
+        coco_waitpid(tids[i], NULL, COCO_WNOOPT);
+    }
+    coco_exit(failed);
+}
+
+int main() { coco_start(kernal, NULL); }
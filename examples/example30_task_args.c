@@ -0,0 +1,132 @@
+/**
+ * @file example30_task_args.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of tasks that take a copy of their arguments
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "coco.h"
+#include "coco_config.h"
+
+#define TASKS 100
+
+struct small {
+    int id;
+    double scale;
+};
+
+struct big {
+    int id;
+    char name[200]; // more than fits in the task
+};
+
+static int bad;
+
+void small_task(void *arg) {
+    struct small *s = arg;
+    coco_yield(); // its arguments stay put while it is switched out
+    bad += s->scale != s->id * 0.5;
+    coco_exit(s->id);
+}
+
+void big_task(void *arg) {
+    struct big *b = arg;
+    char want[sizeof b->name];
+    snprintf(want, sizeof want, "task %d", b->id);
+    coco_yield();
+    bad += strcmp(b->name, want) != 0;
+    coco_exit(b->id);
+}
+
+static int churned;
+
+// a forked child reads the copy its parent was given, after the parent is
+// gone and its slot could have been reused
+void fork_small(void *arg) {
+    struct small *s = arg;
+    int child = coco_fork();
+    if (child != 0) {
+        coco_exit(child);
+    }
+    coco_while(!churned);
+    bad += s->scale != s->id * 0.5;
+    coco_exit(s->id);
+}
+
+void fork_big(void *arg) {
+    struct big *b = arg;
+    int child = coco_fork();
+    if (child != 0) {
+        coco_exit(child);
+    }
+    coco_while(!churned);
+    bad += strcmp(b->name, "forked") != 0;
+    coco_exit(b->id);
+}
+
+/**
+ * @brief fork a task with copied arguments, reap the parent and spawn
+ * enough tasks to go round the task table before the child looks
+ *
+ * @return int how many children exited with the wrong status
+ */
+int forked() {
+    struct small s = {42, 21};
+    struct big b = {43, "forked"};
+    int parents[2] = {add_task_with_args(fork_small, &s, sizeof s),
+                      add_task_with_args(fork_big, &b, sizeof b)};
+    int children[2];
+    for (int i = 0; i < 2; ++i) {
+        coco_waitpid(parents[i], &children[i], COCO_WNOOPT);
+    }
+    for (int i = 0; i < 2 * TASK_SLAB_SIZE; ++i) {
+        struct small other = {i, i * 0.5};
+        struct big otherBig = {i, {0}};
+        snprintf(otherBig.name, sizeof otherBig.name, "task %d", i);
+        int t = i % 2 ? add_task_with_args(small_task, &other, sizeof other)
+                      : add_task_with_args(big_task, &otherBig,
+                                           sizeof otherBig);
+        coco_waitpid(t, NULL, COCO_WNOOPT);
+    }
+    churned = 1;
+    int wrong = 0;
+    for (int i = 0; i < 2; ++i) {
+        int status;
+        coco_waitpid(children[i], &status, COCO_WNOOPT);
+        wrong += status != 42 + i;
+    }
+    return wrong;
+}
+
+void kernal() {
+    int tids[2 * TASKS];
+    for (int i = 0; i < TASKS; ++i) {
+        // both live on this stack and are reused right away
+        struct small s = {i, i * 0.5};
+        struct big b = {i, {0}};
+        snprintf(b.name, sizeof b.name, "task %d", i);
+        tids[2 * i] = add_task_with_args(small_task, &s, sizeof s);
+        tids[2 * i + 1] = add_task_with_args(big_task, &b, sizeof b);
+        memset(&b, 0xff, sizeof b);
+        s.scale = -1;
+    }
+    int wrongStatus = 0;
+    for (int i = 0; i < 2 * TASKS; ++i) {
+        int status;
+        coco_waitpid(tids[i], &status, COCO_WNOOPT);
+        wrongStatus += tids[i] == 0 || status != i / 2;
+    }
+    wrongStatus += forked();
+    printf("%d tasks, %d saw bad arguments, %d bad exit statuses\n",
+           2 * TASKS, bad, wrongStatus);
+    coco_exit(bad != 0 || wrongStatus != 0);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,105 @@
+/**
+ * @file example31_pool.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of a task pool running fan-outs of short jobs
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+
+#include "coco.h"
+#include "pool.h"
+
+#define WORKERS 4
+#define CAPACITY 8 // Less than a fan-out, so submitting has to wait
+#define REQUESTS 200
+#define FANOUT 10
+
+static struct coco_pool pool;
+static int results[FANOUT];
+static int opened;
+
+// a tiny job, some of which yield part way through
+void square(void *arg) {
+    int i = (int)(long)arg;
+    if (i % 3 == 0) {
+        coco_yield();
+    }
+    results[i] = i * i;
+}
+
+void nothing(void *arg) { (void)arg; }
+
+void gate(void *arg) {
+    (void)arg;
+    coco_while(!opened);
+}
+
+/**
+ * @brief run 2^15 jobs through one slot, enough to wrap the 15 generation
+ * bits handles once had, then wait on the first while the slot's job blocks
+ *
+ * @return int 0, or -1 if the pool could not start
+ */
+int stale_handle() {
+    static struct coco_pool single; // read by its worker while we are out
+    if (coco_pool_init(&single, 1, 1) != 0) {
+        return -1;
+    }
+    long long first = coco_pool_submit(&single, nothing, NULL);
+    for (int i = 1; i < 1 << 15; ++i) {
+        coco_pool_wait(&single, coco_pool_submit(&single, nothing, NULL));
+    }
+    long long blocked = coco_pool_submit(&single, gate, NULL);
+    coco_pool_wait(&single, first); // hangs if first names the gate job
+    opened = 1;
+    coco_pool_wait(&single, blocked);
+    coco_pool_destroy(&single);
+    return 0;
+}
+
+void kernal() {
+    if (coco_pool_init(&pool, WORKERS, CAPACITY) != 0 ||
+        coco_pool_init(&pool, 0, CAPACITY) == 0) {
+        coco_exit(2);
+    }
+    int failed = 0;
+    long long handles[FANOUT];
+    for (int r = 0; r < REQUESTS; ++r) {
+        for (int i = 0; i < FANOUT; ++i) {
+            results[i] = -1;
+            handles[i] = coco_pool_submit(&pool, square, (void *)(long)i);
+        }
+        for (int i = 0; i < FANOUT; ++i) {
+            coco_pool_wait(&pool, handles[i]);
+            failed |= handles[i] <= 0 || results[i] != i * i;
+        }
+        // a handle to a finished job returns right away
+        coco_pool_wait(&pool, handles[0]);
+    }
+    // the workers are all the tasks there are besides this one
+    struct coco_runtime_stats rt;
+    coco_runtime_stats(&rt);
+    printf("%d jobs on %llu tasks\n", REQUESTS * FANOUT, rt.liveTasks);
+    failed |= rt.liveTasks != WORKERS + 1;
+
+    // queued jobs still run when the pool is shut down
+    for (int i = 0; i < FANOUT; ++i) {
+        results[i] = -1;
+        coco_pool_submit(&pool, square, (void *)(long)i);
+    }
+    coco_pool_destroy(&pool);
+    for (int i = 0; i < FANOUT; ++i) {
+        failed |= results[i] != i * i;
+    }
+    coco_runtime_stats(&rt);
+    failed |= rt.liveTasks != 1;
+    failed |= stale_handle() != 0;
+    coco_exit(failed);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -0,0 +1,107 @@
+/**
+ * @file example32_run_next.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Demo of woken tasks running right after the task that woke them
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+
+#include "coco.h"
+#include "coco_channel.h"
+#include "semaphore.h"
+#include "waitgroup.h"
+
+#define BYSTANDERS 20
+#define ROUNDS 50
+
+INCLUDE_CHANNEL(int);
+INCLUDE_SIZED_CHANNEL(int, 1);
+
+static struct sized_channel(int, 1) pipe;
+static coco_sem sem;
+static struct waitGroup wg;
+static volatile int done;
+static int turns;  // Turns the bystanders have had
+static int wokeAt; // turns when the last handoff happened
+static int lag[3]; // Most bystander turns between a handoff and its waiter
+
+// other work that is always runnable
+void bystander(void *arg) {
+    (void)arg;
+    while (!done) {
+        ++turns;
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+static void handed_off(int kind) {
+    if (turns - wokeAt > lag[kind]) {
+        lag[kind] = turns - wokeAt;
+    }
+}
+
+void consumer(void *arg) {
+    (void)arg;
+    int v;
+    for (int i = 0; i < ROUNDS; ++i) {
+        extract(int)((struct channel(int) *)&pipe, &v);
+        handed_off(0);
+        coco_sem_wait(&sem);
+        handed_off(1);
+        wg_wait(&wg);
+        handed_off(2);
+        wg_add(&wg, 1);
+    }
+    coco_exit(0);
+}
+
+void producer(void *arg) {
+    (void)arg;
+    for (int i = 0; i < ROUNDS; ++i) {
+        // let the consumer get parked on the empty channel first
+        for (int k = 0; k < 3; ++k) {
+            coco_yield();
+        }
+        wokeAt = turns;
+        send(int)((struct channel(int) *)&pipe, i);
+        coco_yield();
+        wokeAt = turns;
+        coco_sem_post(&sem);
+        coco_yield();
+        wokeAt = turns;
+        wg_done(&wg);
+        coco_yield();
+    }
+    coco_exit(0);
+}
+
+void kernal() {
+    init_channel(&pipe, 1);
+    coco_sem_init(&sem, 0);
+    init_wg(&wg);
+    wg_add(&wg, 1);
+    int bystanders[BYSTANDERS];
+    for (int i = 0; i < BYSTANDERS; ++i) {
+        bystanders[i] = add_task(bystander, NULL);
+    }
+    int c = add_task(consumer, NULL);
+    int p = add_task(producer, NULL);
+    coco_waitpid(c, NULL, COCO_WNOOPT);
+    coco_waitpid(p, NULL, COCO_WNOOPT);
+    done = 1;
+    for (int i = 0; i < BYSTANDERS; ++i) {
+        coco_waitpid(bystanders[i], NULL, COCO_WNOOPT);
+    }
+    printf("most bystander turns before a woken task ran: channel %d, "
+           "semaphore %d, waitgroup %d (of %d bystanders)\n",
+           lag[0], lag[1], lag[2], BYSTANDERS);
+    coco_exit(lag[0] != 0 || lag[1] != 0 || lag[2] != 0);
+}
+
+int main() { coco_start(kernal, NULL); }
@@ -32,18 +32,28 @@ fn yield_for_ms(i: c_uint) {
 }
 
 fn add_task<T>(task: coroutine, args: Option<T>) -> c_int {
-    let in_args = match args {
-        Some(r) => (Box::into_raw(Box::new(r))) as *mut c_void,
-        None => std::ptr::null_mut(),
-    };
-    unsafe { coco::add_task(Some(task), in_args) }
+    match args {
+        // coco keeps a copy of the bytes for the task, take_args moves it out
+        Some(r) => {
+            assert!(std::mem::align_of::<T>() <= 16, "args too aligned");
+            let r = std::mem::ManuallyDrop::new(r);
+            unsafe {
+                coco::add_task_with_args(
+                    Some(task),
+                    &*r as *const T as *const c_void,
+                    std::mem::size_of::<T>() as _,
+                )
+            }
+        }
+        None => unsafe { coco::add_task(Some(task), std::ptr::null_mut()) },
+    }
 }
 
 fn take_args<T>(arg: *mut libc::c_void) -> T {
     let raw_args: *mut T = arg.cast();
     match raw_args {
         _ if raw_args == (std::ptr::null_mut() as *mut T) => panic!("no args"),
-        _ => unsafe { *Box::from_raw(raw_args) },
+        _ => unsafe { std::ptr::read(raw_args) },
     }
 }
 
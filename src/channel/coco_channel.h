@@ -14,6 +14,8 @@
 #include <assert.h>
 #include <stdbool.h>
 
+#include "coco.h"
+
 /**
  * @brief The status of a channel transaction.
  *
@@ -29,6 +31,8 @@ enum channel_status { kOkay, kFull, kEmpty, kReadOnly, kClosed, kUnbuffTings };
  */
 #define extract(T) concat(extract_, T)
 #define send(T) concat(send_, T)
+#define extract_locked(T) concat(extract(T), _locked)
+#define send_locked(T) concat(send(T), _locked)
 #define channel(T) concat(channel_, T)
 #define sized_channel(T, S) concat(concat(channel_, T), concat(_, S))
 
@@ -47,14 +51,18 @@ struct channel_base {
             int count;
         } bufData;
         struct {
-            int reader_waiting : 15;
-            int writer_waiting : 15;
-            int sync_done : 1;
+            int reader_waiting : 15; // readers not yet handed a value
+            int writer_waiting : 15; // writers not yet holding the slot
+            int sync_done : 1;       // a handed off value is in the slot
+            unsigned int deposited;  // values put in the slot so far
+            unsigned int taken;      // values taken out of the slot so far
         } ubufData;
     };
     int closed : 1;
     int read_ready : 1;
     int write_ready : 1;
+    struct coco_waitq readers; // tasks parked until there is data
+    struct coco_waitq writers; // tasks parked until there is room
 };
 
 bool write_ready(struct channel_base * c) {
@@ -69,7 +77,11 @@ bool read_ready(struct channel_base * c) {
  *
  */
 void close(struct channel_base * c) {
+    coco_lock_on(c);
     c->closed = 1;
+    coco_wake_all(&c->readers);
+    coco_wake_all(&c->writers);
+    coco_unlock_on(c);
 }
 
 /**
@@ -100,11 +112,15 @@ void init_channel(struct channel_base *c, int S) {
         (c)->ubufData.reader_waiting = 0;
         (c)->ubufData.writer_waiting = 0;
         (c)->ubufData.sync_done = 0;
+        (c)->ubufData.deposited = 0;
+        (c)->ubufData.taken = 0;
         (c)->type = kUnbuffered;
     }
     (c)->closed = 0;
     (c)->read_ready = 0;
     (c)->write_ready = 0;
+    coco_waitq_init(&(c)->readers);
+    coco_waitq_init(&(c)->writers);
 }
 
 // /**
@@ -121,27 +137,22 @@ void init_channel(struct channel_base *c, int S) {
         T buf[0];                                                              \
     };                                                                         \
                                                                                \
-    /**                                                                        \
-     * @brief extract a member from the fifo if non-empty                      \
-     *                                                                         \
-     * @param[in] c a pointer to the channel                                   \
-     * @param[out] out a reference to a space to store the extracted value     \
-     *                                                                         \
-     * @return the state of the transaction as an enum channel_status          \
-     *                                                                         \
-     */                                                                        \
-    static enum channel_status extract(T)(struct channel(T) * c, T * out) {           \
+    /* extract(T), with the channel's coco_lock_on() held */                  \
+    static enum channel_status extract_locked(T)(struct channel(T) * c,        \
+                                                 T * out) {                    \
         switch (c->type) {                                                     \
         case kBuffered:                                                        \
-            if (c->bufData.count == 0 && closed(c)) {                          \
-                return kClosed;                                                \
-            }                                                                  \
             while (c->bufData.count == 0) {                                    \
-                coco_yield();                                                  \
+                if (closed(c)) {                                               \
+                    *out = 0;                                                  \
+                    return kClosed;                                            \
+                }                                                              \
+                coco_park_on(&c->readers, c);                                  \
             }                                                                  \
             *out = c->buf[(c->bufData.insertPtr - (c->bufData.count--) +       \
                            c->bufData.bufSize) %                               \
                           c->bufData.bufSize];                                 \
+            coco_wake_one(&c->writers);                                        \
             return kOkay;                                                      \
             break;                                                             \
         case kUnbuffered:                                                      \
@@ -150,54 +161,101 @@ void init_channel(struct channel_base *c, int S) {
                 return kClosed;                                                \
             }                                                                  \
             ++c->ubufData.reader_waiting;                                      \
-            do {                                                               \
-                coco_yield();                                                  \
-            } while (!c->ubufData.writer_waiting);                             \
-            --c->ubufData.reader_waiting;                                      \
-            --c->ubufData.writer_waiting;                                      \
-            c->ubufData.sync_done = 1;                                         \
+            coco_wake_all(&c->writers);                                        \
+            while (!c->ubufData.sync_done) {                                   \
+                if (closed(c)) {                                               \
+                    --c->ubufData.reader_waiting;                              \
+                    *out = 0;                                                  \
+                    return kClosed;                                            \
+                }                                                              \
+                coco_park_on(&c->readers, c);                                  \
+            }                                                                  \
+            /* the writer that filled the slot already counted us off */      \
+            c->ubufData.sync_done = 0;                                         \
+            ++c->ubufData.taken;                                               \
             *out = c->buf[0];                                                  \
+            coco_wake_all(&c->writers);                                        \
             return kOkay;                                                      \
             break;                                                             \
         }                                                                      \
         assert(0);                                                             \
     }                                                                          \
                                                                                \
-    /**                                                                        \
-     * @brief queue a member into the fifo if non-full and non-closed          \
-     *                                                                         \
-     * @param[in] c a pointer to the channel                                   \
-     * @param[out] data the data to send                                       \
-     *                                                                         \
-     * @return the state of the transaction as an enum channel_status          \
-     *                                                                         \
-     */                                                                        \
-    static enum channel_status send(T)(struct channel(T) * c, T data) {               \
+    /* send(T), with the channel's coco_lock_on() held */                     \
+    static enum channel_status send_locked(T)(struct channel(T) * c, T data) { \
         switch (c->type) {                                                     \
         case kBuffered:                                                        \
-            if (closed(c))                                                     \
-                return kClosed;                                                \
             while (c->bufData.count == c->bufData.bufSize) {                   \
-                coco_yield();                                                  \
+                if (closed(c))                                                 \
+                    return kClosed;                                            \
+                coco_park_on(&c->writers, c);                                  \
             }                                                                  \
+            if (closed(c))                                                     \
+                return kClosed;                                                \
             c->buf[(c->bufData.insertPtr++) % c->bufData.bufSize] = data;      \
             ++c->bufData.count;                                                \
+            coco_wake_one(&c->readers);                                        \
             break;                                                             \
-        case kUnbuffered:                                                      \
+        case kUnbuffered: {                                                    \
             if (closed(c))                                                     \
                 return kClosed;                                                \
             ++c->ubufData.writer_waiting;                                      \
-            while (!c->ubufData.reader_waiting) {                              \
-                coco_yield();                                                  \
+            /* wait for a reader with no value in the slot yet */             \
+            while (!c->ubufData.reader_waiting || c->ubufData.sync_done) {     \
+                if (closed(c)) {                                               \
+                    --c->ubufData.writer_waiting;                              \
+                    return kClosed;                                            \
+                }                                                              \
+                coco_park_on(&c->writers, c);                                  \
             }                                                                  \
+            --c->ubufData.writer_waiting;                                      \
+            --c->ubufData.reader_waiting;                                      \
             c->buf[0] = data;                                                  \
-            while (!c->ubufData.sync_done) {                                   \
-                coco_yield();                                                  \
+            c->ubufData.sync_done = 1;                                         \
+            unsigned int ticket = ++c->ubufData.deposited;                     \
+            coco_wake_one(&c->readers);                                        \
+            /* and for the value to be taken, it is unbuffered after all */   \
+            while ((int)(c->ubufData.taken - ticket) < 0) {                    \
+                if (closed(c))                                                 \
+                    return kClosed;                                            \
+                coco_park_on(&c->writers, c);                                  \
             }                                                                  \
-            c->ubufData.sync_done = 0;                                         \
             break;                                                             \
         }                                                                      \
+        }                                                                      \
         return kOkay;                                                          \
+    }                                                                          \
+                                                                               \
+    /**                                                                        \
+     * @brief extract a member from the fifo if non-empty                      \
+     *                                                                         \
+     * @param[in] c a pointer to the channel                                   \
+     * @param[out] out a reference to a space to store the extracted value     \
+     *                                                                         \
+     * @return the state of the transaction as an enum channel_status          \
+     *                                                                         \
+     */                                                                        \
+    static enum channel_status extract(T)(struct channel(T) * c, T * out) {    \
+        coco_lock_on(c);                                                       \
+        enum channel_status s = extract_locked(T)(c, out);                     \
+        coco_unlock_on(c);                                                     \
+        return s;                                                              \
+    }                                                                          \
+                                                                               \
+    /**                                                                        \
+     * @brief queue a member into the fifo if non-full and non-closed          \
+     *                                                                         \
+     * @param[in] c a pointer to the channel                                   \
+     * @param[out] data the data to send                                       \
+     *                                                                         \
+     * @return the state of the transaction as an enum channel_status          \
+     *                                                                         \
+     */                                                                        \
+    static enum channel_status send(T)(struct channel(T) * c, T data) {        \
+        coco_lock_on(c);                                                       \
+        enum channel_status s = send_locked(T)(c, data);                       \
+        coco_unlock_on(c);                                                     \
+        return s;                                                              \
     }
 
 /**                                                                        \
@@ -209,7 +267,7 @@ void init_channel(struct channel_base *c, int S) {
  * @return the state of the transaction as an enum channel_status          \
  *                                                                         \
  */
-enum channel_status status(struct channel_base *c) {
+static enum channel_status status_locked(struct channel_base *c) {
     switch (c->type) {
     case kBuffered:
         if (closed(c) && c->bufData.count > 0)
@@ -231,7 +289,7 @@ enum channel_status status(struct channel_base *c) {
         if (c->ubufData.reader_waiting) {
             return kEmpty;
         }
-        if (c->ubufData.writer_waiting) {
+        if (c->ubufData.writer_waiting || c->ubufData.sync_done) {
             return kFull;
         }
         return kUnbuffTings;
@@ -241,16 +299,25 @@ enum channel_status status(struct channel_base *c) {
     assert(0);
 }
 
+enum channel_status status(struct channel_base *c) {
+    coco_lock_on(c);
+    enum channel_status s = status_locked(c);
+    coco_unlock_on(c);
+    return s;
+}
+
 void chan_select(int num_channels, struct channel_base *cs[num_channels]) {
     for (int i = 0; i < num_channels; ++i) {
+        coco_lock_on(cs[i]);
         cs[i]->read_ready = 0;
         cs[i]->write_ready = 0;
-        enum channel_status s = status(cs[i]);
+        enum channel_status s = status_locked(cs[i]);
         if (s == kOkay || s == kEmpty) {
             cs[i]->write_ready = 1;
         }
         if (s == kClosed || s == kReadOnly || s == kOkay || s == kFull) {
             cs[i]->read_ready = 1;
         }
+        coco_unlock_on(cs[i]);
     }
 }
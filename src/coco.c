@@ -9,9 +9,40 @@
  * @copyright Copyright (c) 2023
  *
  */
+#define _GNU_SOURCE ///< ppoll, pthread_setaffinity_np
 #include "coco.h"
+#include "coco_clock.h"
+#include "coco_frames.h"
+#include "coco_jmp.h"
+#include "coco_trace.h"
+#include "reactor.h"
+#include <errno.h>
+#include <signal.h> ///< sigprocmask for tasks that keep their mask
+#include <stdalign.h> ///< alignas for inline task arguments
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <poll.h>        ///< ppoll for sleeping while idle
+#include <pthread.h>     ///< worker threads
+#include <sys/eventfd.h> ///< eventfd to wake an idle scheduler
+#include <sys/mman.h>    ///< mmap for separate task stacks
+#include <unistd.h>   ///< sysconf for the guard page size
+
+struct task;
+
+/**
+ * Struct: stack
+ *
+ * A stack a task runs on in COCO_STACK_SEPARATE mode. A stack can be shared
+ * (a forked child runs on its parent's stack at the same addresses), so the
+ * frame of whoever occupies it is only copied out when another task needs it.
+ *
+ */
+struct stack {
+    char *base;         // Lowest usable address, just above the guard page
+    size_t size;        // Usable size in bytes
+    struct task *owner; // The task whose frame is currently on the stack
+};
 
 /**
  * Struct: context
@@ -21,17 +52,19 @@
  *
  */
 struct context {
-    jmp_buf caller;      // The paused context of the caller
-    jmp_buf resumePoint; // The paused context of the coroutine
+    coco_jmp_buf caller;      // The paused context of the caller
+    coco_jmp_buf resumePoint; // The paused context of the coroutine
     signalHandler
         handlers[NUM_SIGNALS]; // The signal handlers for this coroutine
-    clock_t waitStart; // The time at which this coroutine started waiting
     int exitStatus;    // The exit status of this coroutine
     void *args;        // The arguments passed to this coroutine
-    char savedFrame[USR_CTX_SIZE]; // The saved stack frame of this coroutine
     void *frameStart;              // The start of the context's stack frame
+    void *frameEnd;                // The stack pointer when it last paused
     ptrdiff_t frameSize;           // The size of the context's stack frame
+    struct stack *stack; // The stack it runs on, NULL in COCO_STACK_COPY mode
     int detached; // Whether this coroutine is detached from it's parent
+    bool keepSigmask; // Whether the signal mask is switched with the task
+    sigset_t sigmask; // The task's signal mask while it is switched out
 };
 
 /**
@@ -45,6 +78,8 @@ struct context {
  * - kYielding: running normally
  * - kStopped: running, execution paused
  * - kNew: task created and queued to run
+ * - kSleeping: off the run queue, waiting in the timer heap
+ * - kBlocked: off the run queue, parked on a coco_waitq
  *
  */
 enum task_status {
@@ -54,33 +89,156 @@ enum task_status {
     kYielding,
     kStopped,
     kNew,
+    kSleeping,
+    kBlocked,
 };
 
 /**
- * @brief Structure of a task from the OS's POV.
+ * @brief What coco_task_stats() reports, with times in cpu_ticks()
  */
-struct task {
-    enum task_status status; // The status of the task
+struct task_counters {
+    unsigned long long resumes;
+    uint64_t runTicks;
+    uint64_t readyTicks;
+    uint64_t readySince; // When it last became runnable
+    unsigned long long copiedBytes;
+    unsigned long long peakFrame;
+};
+
+/**
+ * @brief The parts of a task the scheduler only needs once it switches to
+ * it: its context, saved frame and arguments, and its counters.
+ */
+struct task_cold {
     struct context ctx;      // The context of the task
     coroutine func;          // The function to run for the task
+    struct stack ownStack;   // Lazily mapped stack, kept across slot reuse
+    struct coco_waitq exitWaiters; // Tasks blocked in coco_waitpid on it
+    struct frame savedFrame; // Copy of its stack frame while switched out
+    struct frame argFrame;   // Arguments too big for inlineArgs
+    alignas(max_align_t) char inlineArgs[TASK_INLINE_ARGS]; // Arguments
+                             // copied in by add_task_with_args()
+    struct task *argOwner;   // Whose copied arguments a forked task reads
+    unsigned argReaders;     // Forked tasks still reading our arguments
+    bool held;               // Freed, but kept for its argReaders
+    struct coco_edf_stats edfStats;
+    struct task_counters counters; // See coco_task_stats()
+};
+
+/**
+ * @brief Structure of a task from the OS's POV. It only holds what walking
+ * the run queues, the timer heap and the EDF list reads, so those touch one
+ * small node per task; the rest is in cold.
+ */
+struct task {
+    enum task_status status; // The status of the task
+    bool stopped;            // Whether a SIGSTP is in effect
+    bool sharedStack;        // Takes a shared stack of the worker starting it
+    int prio;                // Its priority level, 0 runs first
     struct task *next;       // The next task in the list
     struct task *prev;       // The previous task in the list
+    struct task *home;       // The queue the task runs from when awake
+    struct worker *worker;   // The worker it runs on
+    struct task_cold *cold;  // The rest of it, NULL for list heads
+    uint64_t wakeAt;         // CLOCK_MONOTONIC ns at which it is due asleep
+    uint64_t deadline;       // EDF: when its current job is due
+    uint64_t release;        // EDF: when its current job was released
+    uint64_t period;         // EDF: ns between releases, 0 if best effort
+    uint64_t relDeadline;    // EDF: ns from a release to its deadline
+    int heapIndex;           // Its position in the timer heap while asleep
+    int index;               // Its slot in the task table
+    unsigned generation;     // Bumped every time the slot is freed
+};
+
+/**
+ * @brief A scheduler thread and the queues only it runs. Worker 0 is the
+ * thread that called coco_start. A task stays on the worker that started it,
+ * since a copying task's frame lives at fixed addresses on that worker's
+ * stack, so only tasks that haven't started yet move between workers.
+ * Sharded workers never steal: each is an independent scheduler on its own
+ * CPU, and other threads only reach it through its mailbox.
+ *
+ */
+struct worker {
+    struct task levels[PRIO_LEVELS]; // The tasks it runs, by priority
+    unsigned nonEmpty;        // Bit l is set if levels[l] may have tasks
+    unsigned passed[PRIO_LEVELS]; // Passes each level has waited
+    struct task dpcs;         // The DPCs it runs
+    struct task edf;          // Its runnable EDF tasks, earliest deadline
+                              // first, ahead of every priority level
+    int numEdf;               // Its EDF tasks, runnable or not
+    struct task spawned;      // New tasks, it takes the newest, thieves the
+                              // oldest
+    struct task *mailbox;     // Tasks other threads woke up or spawned here,
+                              // a lock-free stack linked through next
+    struct task *runNext;     // The first task the running one woke up
+    int runChain;             // Tasks run in a row through runNext
+    int numSpawned;           // Length of spawned
+    pthread_mutex_t lock;     // Guards spawned
+    bool idle;                // Whether it is (about to be) in idle_wait()
+    struct task **timers;     // Its sleepers, a binary min-heap on their
+                              // deadline so only due tasks get switched to
+    int numTimers;
+    int timersSize;                // Allocated length of timers
+    struct stack **sharedStacks;   // Its stacks for COCO_STACK_SHARED tasks
+    int mappedSharedStacks;        // How many of them are mapped
+    int nextSharedStack;           // Where the next task lands
+    int wakeFd;                    // Written to end its idle sleep
+    struct coco_idle_stats idleStats;
+    unsigned long long copiedBytes; // Frame bytes copied by its switches
+    unsigned long long steals;      // Times it took another's tasks
+    uint64_t lastTick;              // cpu_ticks() at its last switch or wake
+    unsigned long long frameHist[FRAME_HIST_BUCKETS]; // Frames it saved,
+                                                      // by frame_bucket()
+    struct task freeTasks;          // Free slots of the slabs it owns
+    pthread_mutex_t slotLock;       // Guards them, see slots_lock()
+    pthread_mutex_t *parkLock;      // The lock the task switching out holds
+    struct task_counters retired;   // Summed counters of its freed tasks
+    struct frame_profile retiredFrames; // Peak frames of its freed tasks
+    int index;                      // Its place in workers
+    pthread_t thread;
 };
 
-static struct context *ctx;      // The context of the currently running task
-static struct task *currentTask; // The currently running task
-static bool can_yield = true;    // Whether the current task can yield
+static __thread struct context *ctx; // The context of the running task
+static __thread struct task *currentTask; // The running task
+static __thread bool can_yield = true;    // Whether it can yield
+static __thread struct worker *self;      // The worker of this thread
+static struct worker mainWorker;          // Worker 0
+static struct worker **workers = (struct worker *[]){&mainWorker};
+static int numWorkers = 1;
+static int numThreads = 1;  // Workers plus the DPC thread if there is one
+static bool threaded;       // Whether more than one thread schedules tasks
+static bool dpcThreadWanted; // See coco_set_dpc_thread()
+static struct worker *dpcWorker; // The thread running DPCs, if any
+static bool numWorkersSet = false; // Whether coco_set_workers was called
+static bool sharded = false;       // Whether the workers are shards
+static unsigned agingPasses = PRIO_AGING_PASSES; // See coco_set_prio_aging
+static pthread_mutex_t rtLock = PTHREAD_MUTEX_INITIALIZER; // coco_lock()
+static struct {
+    alignas(64) pthread_mutex_t m; // A cache line each
+} objLocks[LOCK_STRIPES]; // coco_lock_on()
+static enum coco_stack_mode stackMode = DEFAULT_STACK_MODE;
+static int sharedStackCount; // How many shared stacks new tasks spread over
+static bool stackModeSet = false; // Whether coco_set_stack_mode was called
+static sigset_t schedulerMask;    // The mask of the scheduler and plain tasks
+static int mainWakeFd = -1; // Worker 0's wakeFd for other threads, once set
+static uint64_t startTicks, startNs; // cpu_ticks() and the time at start
 
 /**
- * @brief All tasks and their contexts must be kept in program memory, since the
- * stack can get corrupted when longjmp'ing back and forth, and embedded
- * applications don't like malloc.
+ * @brief All tasks and their contexts must be kept off the stack, since the
+ * stack can get corrupted when longjmp'ing back and forth. They live in slabs
+ * of TASK_SLAB_SIZE that are allocated as the table grows and never move or
+ * get freed, with their cold parts in a slab of their own alongside. A tid is
+ * a slot index tagged with the slot's generation, so the tid of a reaped task
+ * doesn't name the next task in its slot. Each slab belongs to a worker,
+ * whose free list its slots go back to: worker 0, or with shards the shard
+ * that grew it, so its index tells which shard a tid is from.
  *
  */
-static struct task tasks[MAX_TASKS];
-static struct task runningTasks;
-static struct task freeTasks;
-static struct task dpcs;
+static struct task *slabs[MAX_TASKS / TASK_SLAB_SIZE];
+static struct worker *slabOwners[MAX_TASKS / TASK_SLAB_SIZE];
+static int numSlots; // Slots in allocated slabs, slot 0 is never used
+static pthread_mutex_t growLock = PTHREAD_MUTEX_INITIALIZER; // Guards growth
 
 /**
  * @brief insert a node into a circular doubly linked list
@@ -120,311 +278,2168 @@ void cdll_print(struct task *tasks) {
     printf("\n");
 }
 
-void default_sigint(void) { coco_exit(1); }
-void default_sigstp(void) { return; }
-void default_sigcont(void) { return; }
+#define TID_INDEX_MASK (MAX_TASKS - 1)
+#define TID_GENERATIONS (1u << (31 - TID_INDEX_BITS)) // Keeps tids positive
+
 /**
- * @brief Initialize a task for use in the scheduler
+ * @brief the tid naming a task
  *
- * @param[in] t the task to initialize
- * @param[in] func the function to run for the task
- * @param[in] args the arguments to pass to the function
  */
-void init_task(struct task *t, coroutine func, void *args) {
-    t->status = kNew;
-    t->func = func,
-    t->ctx = (struct context){
-        .args = args,
-        .waitStart = clock(),
-        .handlers = {default_sigint, default_sigstp, default_sigcont},
-        .detached = false};
+static inline int tid_of(struct task *t) {
+    return (int)((t->generation % TID_GENERATIONS) << TID_INDEX_BITS) |
+           t->index;
 }
 
-int add_task_to_queue(coroutine func, void *args, struct task *list) {
-    for (struct task *node = freeTasks.next; node != &freeTasks;
-         node = node->next) {
-        if (node->status == kDead || node->status == kUDead) {
-            init_task(node, func, args);
-            cdll_remove(node);
-            cdll_insert(list, node);
-            return node - tasks;
-        }
-    }
-    assert(false && "No more tasks available");
-    return 0;
+/**
+ * @brief the task in a slot of the table
+ *
+ */
+static inline struct task *task_at(int index) {
+    return &slabs[index / TASK_SLAB_SIZE][index % TASK_SLAB_SIZE];
 }
 
 /**
- * @brief Add a task to the scheduler
+ * @brief find the task a tid names
  *
- * @param[in] func the function to run for the task
- * @param[in] args the arguments to pass to the function
- * @return int the tid of the task
+ * @param[in] tid the tid
+ * @return struct task* the task, NULL if the tid is stale or was never handed
+ * out
  */
-int add_task(coroutine func, void *args) {
-    return add_task_to_queue(func, args, &runningTasks);
+static struct task *lookup_task(int tid) {
+    int index = tid & TID_INDEX_MASK;
+    if (tid <= 0 || index == 0 ||
+        index >= __atomic_load_n(&numSlots, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    struct task *t = task_at(index);
+    if (tid_of(t) != tid || t->status == kDead || t->status == kUDead) {
+        return NULL;
+    }
+    return t;
 }
 
 /**
- * @brief Add a task to the dpc queue
+ * @brief the worker whose slabs tasks started on w take their slots from
  *
- * @param[in] func the function to run for the task
- * @param[in] args the arguments to pass to the function
- * @return int the tid of the task
  */
-int add_dpc(coroutine func, void *args) {
-    int tid = add_task_to_queue(func, args, &dpcs);
-    tasks[tid].ctx.detached = true;
-    return tid;
+static inline struct worker *slot_owner(struct worker *w) {
+    return sharded ? w : &mainWorker;
 }
 
 /**
- * @brief Run a single task that has already been started/
+ * @brief the lock guarding a worker's free slots and the exits and reaping
+ * of the tasks in them: a lock of its own for a shard, so shards spawn and
+ * reap without touching each other, the runtime lock otherwise
  *
- * @param[in] i the tid of the task to run
- * @return enum task_status the status of said task after it yields
  */
-enum task_status runTask(struct task *t) {
-    int ret;
-    if ((ret = setjmp(t->ctx.caller)) == 0) {
-        ctx = &t->ctx;
-        longjmp(ctx->resumePoint, 0 + 1);
+static inline pthread_mutex_t *slots_lock(struct worker *w) {
+    return sharded ? &w->slotLock : &rtLock;
+}
+
+static inline void take_lock(pthread_mutex_t *m) {
+    if (threaded) {
+        pthread_mutex_lock(m);
+    }
+}
+
+static inline void drop_lock(pthread_mutex_t *m) {
+    if (threaded) {
+        pthread_mutex_unlock(m);
     }
-    return ret;
 }
 
 /**
- * @brief Start a single task that has not already been started
+ * @brief the slots_lock() of the slot a task is in
  *
- * @param[in] i the tid of the task to start
- * @return enum task_status the status of said task after it yields
  */
-enum task_status startTask(struct task *t) {
-    int ret;
-    if ((ret = setjmp(t->ctx.caller)) == 0) {
-        ctx = &t->ctx;
+static inline pthread_mutex_t *task_lock(struct task *t) {
+    return slots_lock(slabOwners[t->index / TASK_SLAB_SIZE]);
+}
 
-        defineSP();
-        ctx->frameStart = sp;
-        t->func(ctx->args);
-        // if a task returns normally, just gracefully exit for it
-        // but assert that this should never happen in debug mode
-        coco_exit(0);
+/**
+ * @brief take the lock guarding the slot a tid indexes, see slots_lock()
+ *
+ * @return pthread_mutex_t* the lock, for drop_lock()
+ */
+static pthread_mutex_t *lock_tid(int tid) {
+    int index = tid & TID_INDEX_MASK;
+    pthread_mutex_t *m =
+        tid > 0 && index < __atomic_load_n(&numSlots, __ATOMIC_ACQUIRE)
+            ? slots_lock(slabOwners[index / TASK_SLAB_SIZE])
+            : &rtLock;
+    take_lock(m);
+    return m;
+}
+
+/**
+ * @brief add a slab to the table and put its slots on a worker's free list,
+ * with that worker's slots_lock() held
+ *
+ * @return bool false if the table is full or out of memory
+ */
+static bool grow_table(struct worker *w) {
+    take_lock(&growLock);
+    int base = numSlots;
+    struct task *slab = NULL;
+    struct task_cold *cold = NULL;
+    if (base < MAX_TASKS) {
+        slab = calloc(TASK_SLAB_SIZE, sizeof(struct task));
+        cold = calloc(TASK_SLAB_SIZE, sizeof(struct task_cold));
     }
-    return ret;
+    if (slab == NULL || cold == NULL) {
+        drop_lock(&growLock);
+        free(slab);
+        free(cold);
+        return false;
+    }
+    slabs[base / TASK_SLAB_SIZE] = slab;
+    slabOwners[base / TASK_SLAB_SIZE] = w;
+    // lowest index first, so tids come out in order
+    for (int i = TASK_SLAB_SIZE - 1; i >= (base == 0); --i) {
+        slab[i].index = base + i;
+        slab[i].cold = &cold[i];
+        cdll_insert(&w->freeTasks, &slab[i]);
+    }
+    // lookups read the slab only once its slots are counted
+    __atomic_store_n(&numSlots, base + TASK_SLAB_SIZE, __ATOMIC_RELEASE);
+    drop_lock(&growLock);
+    return true;
 }
 
-void stopRunningTask() { currentTask->status = kStopped; coco_yield(); }
+/**
+ * @brief take a slot off a worker's free list, growing the table when it is
+ * empty. Call with its slots_lock() held.
+ *
+ * @param[in] w the worker the task will start on
+ * @return struct task* the slot, NULL if the table is full
+ */
+static struct task *alloc_task(struct worker *w) {
+    w = slot_owner(w);
+    if (w->freeTasks.next == &w->freeTasks && !grow_table(w)) {
+        return NULL;
+    }
+    struct task *t = w->freeTasks.next;
+    cdll_remove(t);
+    return t;
+}
 
-void runDPCs() {
-    while (1) {
-        struct task *next = NULL;
-        for (struct task *t = dpcs.next; t != &dpcs; t = next) {
-            currentTask = t;
-            next = t->next;
-            switch (t->status) {
-            case kYielding:
-                t->status = runTask(t);
-                break;
-            case kNew:
-                t->status = startTask(t);
-                break;
-            default:
-                break;
-            }
-        }
-        if (dpcs.next == &dpcs) {
-            break;
-        }
-    } // PUT THEM ON DIFFERENT THREADS
+/**
+ * @brief put a slot whose task is gone and whose arguments nobody reads on
+ * the free list
+ *
+ */
+static void release_slot(struct task *t) {
+    struct task_cold *c = t->cold;
+    struct worker *w = slabOwners[t->index / TASK_SLAB_SIZE];
+    c->held = false;
+    frame_release(&c->argFrame);
+    // to the tail, so reuse cycles through every free slot before a tid can
+    // come round again
+    cdll_insert(w->freeTasks.prev, t);
 }
 
 /**
- * @brief run all currently running tasks once
+ * @brief give a slot back, retiring its tid. Forked children read their
+ * parent's copied arguments where they are, so the slot is held until the
+ * last of them is freed too.
  *
  */
-void runTasks() {
-    struct task *next = NULL;
-    for (struct task *t = runningTasks.next; t != &runningTasks;
-         t = next) {
-        runDPCs();
-        currentTask = t;
-        next = currentTask->next;
-        switch (currentTask->status) {
-        case kYielding:
-            currentTask->status = runTask(currentTask);
-            break;
-        case kNew:
-            currentTask->status = startTask(currentTask);
-            break;
-        default:
-            break;
-        }
+static void free_task(struct task *t) {
+    struct task_cold *c = t->cold;
+    struct worker *w = slabOwners[t->index / TASK_SLAB_SIZE];
+    struct task_counters *retired = &w->retired;
+    retired->resumes += c->counters.resumes;
+    retired->runTicks += c->counters.runTicks;
+    retired->readyTicks += c->counters.readyTicks;
+    retired->copiedBytes += c->counters.copiedBytes;
+    if (c->counters.peakFrame > retired->peakFrame) {
+        retired->peakFrame = c->counters.peakFrame;
     }
+    frame_profile_add(&w->retiredFrames, c->func, c->counters.peakFrame);
+    ++t->generation;
+    frame_release(&c->savedFrame);
+    struct task *owner = c->argOwner;
+    c->argOwner = NULL;
+    if (owner != NULL && --owner->cold->argReaders == 0 &&
+        owner->cold->held) {
+        release_slot(owner);
+    }
+    if (c->argReaders > 0) {
+        c->held = true;
+        return;
+    }
+    release_slot(t);
 }
 
 /**
- * @brief Get the Status of a task
+ * @brief the clock read on every switch for the task counters, always 0
+ * with TASK_CLOCK off
  *
- * @param[in] tid the id of the task
- * @return enum task_status representing said status
  */
-enum task_status getStatus(int tid) { return tasks[tid].status; }
+static inline uint64_t cpu_ticks() {
+#if TASK_CLOCK
+    return cycle_ticks();
+#else
+    return 0;
+#endif
+}
 
 /**
- * @brief: Get the Context of a task
+ * @brief convert cpu_ticks() to ns by the rate they ran at since coco_start
  *
- * @param[in]: tid the id of the task
- * return: struct context*
  */
-struct context *getContext(int tid) {
-    return (struct context *)&tasks[tid].ctx;
+static unsigned long long ticks_to_ns(uint64_t ticks) {
+    uint64_t dt = cpu_ticks() - startTicks;
+    uint64_t dn = monotonic_ns() - startNs;
+    return dt == 0 ? ticks : (unsigned long long)((double)ticks * dn / dt);
 }
 
-int coco_waitpid(int tid, int *exitStatus, int options) {
+static void timer_swap(int i, int j) {
+    struct task *t = self->timers[i];
+    self->timers[i] = self->timers[j];
+    self->timers[j] = t;
+    self->timers[i]->heapIndex = i;
+    self->timers[j]->heapIndex = j;
+}
+
+static void timer_up(int i) {
+    while (i > 0 &&
+           self->timers[(i - 1) / 2]->wakeAt > self->timers[i]->wakeAt) {
+        timer_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void timer_down(int i) {
     for (;;) {
-        if (getStatus(tid) == kDone) {
-            tasks[tid].status = kDead;
-            if (exitStatus != NULL) {
-                *exitStatus = getContext(tid)->exitStatus;
+        int min = i;
+        for (int c = 2 * i + 1; c <= 2 * i + 2 && c < self->numTimers; ++c) {
+            if (self->timers[c]->wakeAt < self->timers[min]->wakeAt) {
+                min = c;
             }
-            cdll_insert(&freeTasks, &tasks[tid]);
-            return tid;
         }
-        if (options & COCO_WNOHANG) {
-            break;
+        if (min == i) {
+            return;
         }
-        coco_yield();
+        timer_swap(i, min);
+        i = min;
     }
-    return 0;
 }
 
-void coco_start(coroutine kernal, void *args) {
-    int texit;
-    freeTasks.next = &freeTasks;
-    freeTasks.prev = &freeTasks;
-    runningTasks.next = &runningTasks;
-    runningTasks.prev = &runningTasks;
-    dpcs.next = &dpcs;
-    dpcs.prev = &dpcs;
-    for (int i = MAX_TASKS; i >= 1; --i) {
-        cdll_insert(&freeTasks, &tasks[i]);
+/**
+ * @brief put a task in the timer heap, it must already be off its queue
+ *
+ * @param[in] t the task, with wakeAt set
+ */
+static void timer_add(struct task *t) {
+    if (self->numTimers == self->timersSize) {
+        self->timersSize = self->timersSize ? 2 * self->timersSize : TASK_SLAB_SIZE;
+        self->timers = realloc(self->timers,
+                               self->timersSize * sizeof *self->timers);
+        assert(self->timers != NULL && "Out of memory for the timer heap");
     }
+    t->heapIndex = self->numTimers;
+    self->timers[self->numTimers++] = t;
+    timer_up(t->heapIndex);
+}
 
-    for (int kernalid = add_task((coroutine)kernal, args);
-         !coco_waitpid(kernalid, &texit, COCO_WNOHANG);) {
-        runTasks();
+/**
+ * @brief take a task out of the timer heap
+ *
+ * @param[in] t the task
+ */
+static void timer_remove(struct task *t) {
+    int i = t->heapIndex;
+    timer_swap(i, --self->numTimers);
+    if (i < self->numTimers) {
+        timer_down(i);
+        timer_up(i);
     }
-    exit(texit);
 }
 
-#define saveStack()                                                            \
-    do {                                                                       \
-        defineSP();                                                            \
-        ptrdiff_t stackSize = (char *)ctx->frameStart - (char *)sp;            \
-        assert((stackSize < USR_CTX_SIZE) &&                                   \
-               "Stack too big to store, increase stack storage limit or fix "  \
-               "program.");                                                    \
-        memcpy(ctx->savedFrame, sp, stackSize);                                \
-        ctx->frameSize = stackSize;                                            \
-    } while (0)
-
-#define restoreStack()                                                         \
-    do {                                                                       \
-        defineSP();                                                            \
-        ptrdiff_t stackSize = ctx->frameSize;                                  \
-        memcpy(sp, ctx->savedFrame, stackSize);                                \
-    } while (0)
+/**
+ * @brief end a worker's idle sleep
+ *
+ */
+static void wake_worker(struct worker *w) {
+    uint64_t one = 1;
+    ssize_t n = write(w->wakeFd, &one, sizeof one);
+    (void)n; // EAGAIN means a wake up is already pending
+}
 
-void coco_yield() {
-    if (!can_yield) {
-        assert(false && "Can't yield here");
-    }
-    saveStack();
-    if (setjmp(ctx->resumePoint) == 0) {
-        longjmp(ctx->caller, kYielding);
+/**
+ * @brief put a task on its home queue, at the back or, for a task that has
+ * never run, at the front. Only the task's own worker may call this.
+ *
+ * @param[in] t the task, on no list
+ * @param[in] front whether it goes at the front
+ */
+static inline void enqueue(struct task *t, bool front) {
+    struct task *q = t->home;
+    t->cold->counters.readySince = self->lastTick;
+    if (q == &t->worker->dpcs) {
+        cdll_insert(q->prev, t);
+    } else if (q == &t->worker->edf) {
+        // few EDF tasks are runnable at once and most are due last
+        struct task *after = q->prev;
+        while (after != q && after->deadline > t->deadline) {
+            after = after->prev;
+        }
+        cdll_insert(after, t);
     } else {
+        cdll_insert(front ? q : q->prev, t);
+        t->worker->nonEmpty |= 1u << t->prio;
     }
-    restoreStack();
 }
 
-void yieldForMs(unsigned int ms) {
-    if (!can_yield) {
-        assert(false && "Can't yield here");
+/**
+ * @brief hand a task to its worker from another thread. The worker moves it
+ * to its queue at the start of its next pass.
+ *
+ * @param[in] t the task, on no list
+ */
+static void mailbox_push(struct task *t) {
+    struct worker *w = t->worker;
+    struct task *head = __atomic_load_n(&w->mailbox, __ATOMIC_RELAXED);
+    do {
+        t->next = head;
+    } while (!__atomic_compare_exchange_n(&w->mailbox, &head, t, true,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    // pairs with idle_wait() announcing it is idle before a last look
+    if (__atomic_load_n(&w->idle, __ATOMIC_SEQ_CST)) {
+        wake_worker(w);
     }
-    saveStack();
-    ctx->waitStart = clock();
-    if (setjmp(ctx->resumePoint) == 0) {
-        longjmp(ctx->caller, kYielding);
-    } else {
+}
+
+/**
+ * @brief move everything other threads handed this worker to its queues,
+ * oldest first
+ *
+ */
+static void mailbox_drain() {
+    struct task *t = __atomic_exchange_n(&self->mailbox, NULL,
+                                         __ATOMIC_ACQUIRE);
+    struct task *oldest = NULL;
+    while (t != NULL) {
+        struct task *next = t->next;
+        t->next = oldest;
+        oldest = t;
+        t = next;
     }
-    restoreStack();
-    if (((clock() - ctx->waitStart) * CLOCKS_TO_MS) < ((clock_t)ms)) {
-        saveStack();
-        longjmp(ctx->caller, kYielding);
+    for (t = oldest; t != NULL; t = oldest) {
+        oldest = t->next;
+        enqueue(t, false);
     }
 }
-inline void yieldForS(unsigned int s) { yieldForMs(s * 1000); }
 
-void coco_detach() { ctx->detached = true; }
+/**
+ * @brief put a task that was off the run queues back at the end of its own,
+ * through its worker's mailbox if that is another thread
+ *
+ * @param[in] t the task
+ */
+static void make_runnable(struct task *t) {
+    trace_event(TRACE_WAKE, tid_of(t), self->index, 0);
+    t->status = kYielding;
+    if (t->worker == self) {
+        enqueue(t, false);
+    } else {
+        mailbox_push(t);
+    }
+}
 
-void coco_exit(unsigned int stat) {
-    if (!can_yield) {
-        assert(false && "Can't yield here");
+/**
+ * @brief move every sleeper whose deadline has passed back to its queue
+ *
+ */
+static void wake_sleepers() {
+    if (self->numTimers == 0) {
+        return;
     }
-    ctx->exitStatus = stat;
-    setjmp(ctx->resumePoint);
-    cdll_remove(currentTask);
-    if (ctx->detached) {
-        cdll_insert(&freeTasks, currentTask);
+    uint64_t now = monotonic_ns();
+    while (self->numTimers > 0 && self->timers[0]->wakeAt <= now) {
+        struct task *t = self->timers[0];
+        timer_remove(t);
+        make_runnable(t);
     }
-    longjmp(ctx->caller, ctx->detached ? kDead : kDone);
 }
 
-size_t next_free_task() {
-    for (size_t i = 1; i <= MAX_TASKS; ++i) {
-        if (tasks[i].status == kDead || tasks[i].status == kUDead) {
-            return i;
-        }
+void default_sigint(void) { coco_exit(1); }
+void default_sigstp(void) { return; }
+void default_sigcont(void) { return; }
+/**
+ * @brief Initialize a task for use in the scheduler
+ *
+ * @param[in] t the task to initialize
+ * @param[in] func the function to run for the task
+ * @param[in] args the arguments to pass to the function
+ */
+void init_task(struct task *t, coroutine func, void *args) {
+    t->status = kNew;
+    t->stopped = false;
+    t->period = 0;
+    struct task_cold *c = t->cold;
+    c->edfStats = (struct coco_edf_stats){0};
+    c->counters = (struct task_counters){0};
+    coco_waitq_init(&c->exitWaiters);
+    c->func = func,
+    c->ctx = (struct context){
+        .args = args,
+        .handlers = {default_sigint, default_sigstp, default_sigcont},
+        .detached = false};
+}
+
+void coco_set_stack_mode(enum coco_stack_mode mode) {
+    stackMode = mode;
+    stackModeSet = true;
+}
+
+/**
+ * @brief map a stack with a guard page below it
+ *
+ * @param[out] s the stack
+ * @return int 0, or -1 if it could not be mapped
+ */
+static int map_stack(struct stack *s) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    char *mem = mmap(NULL, TASK_STACK_SIZE + page, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (mem == MAP_FAILED) {
+        return -1;
     }
+    if (mprotect(mem, page, PROT_NONE) != 0) {
+        munmap(mem, TASK_STACK_SIZE + page);
+        return -1;
+    }
+    s->base = mem + page;
+    s->size = TASK_STACK_SIZE;
+    s->owner = NULL;
     return 0;
 }
 
-int coco_fork() {
-    volatile size_t tid = next_free_task();
-    if (tid == 0) {
-        return 0;
+/**
+ * @brief Get the task's own stack, mapping it the first time the slot needs
+ * one
+ *
+ * @param[in] t the task
+ * @return struct stack* the stack or NULL if it could not be mapped
+ */
+static struct stack *get_stack(struct task *t) {
+    struct stack *s = &t->cold->ownStack;
+    if (s->base == NULL && map_stack(s) != 0) {
+        return NULL;
     }
-    struct task *childTask = &tasks[tid];
-    cdll_remove(&tasks[tid]);
-    cdll_insert(&runningTasks, &tasks[tid]);
-    childTask->status = kYielding;
+    return s;
+}
 
-    saveStack();
-    struct context *child = &childTask->ctx;
-    memcpy(child, ctx, sizeof(struct context));
-    if (setjmp(child->resumePoint) != 0) {
-        restoreStack();
+/**
+ * @brief make sure a worker has its first k shared stacks mapped
+ *
+ * @param[in] w the worker
+ * @param[in] k how many
+ * @return int 0, or -1 if they could not be mapped
+ */
+static int map_shared_stacks(struct worker *w, int k) {
+    if (k <= w->mappedSharedStacks) {
         return 0;
     }
-    return tid;
+    struct stack **grown = realloc(w->sharedStacks, k * sizeof *grown);
+    if (grown == NULL) {
+        return -1;
+    }
+    w->sharedStacks = grown;
+    for (; w->mappedSharedStacks < k; ++w->mappedSharedStacks) {
+        struct stack *s = malloc(sizeof *s);
+        if (s == NULL || map_stack(s) != 0) {
+            free(s);
+            return -1;
+        }
+        w->sharedStacks[w->mappedSharedStacks] = s;
+    }
+    return 0;
 }
 
-void coco_kill(int tid, enum sig signal) {
-    struct context *ctx = getContext(tid);
-    can_yield = false;
-    ctx->handlers[signal]();
-    can_yield = true;
-    switch (signal) {
-    case COCO_SIGSTP:
-        tasks[tid].status = kStopped;
-        break;
-    case COCO_SIGCONT:
-        tasks[tid].status = kYielding;
-        break;
-    default:
-        break;
+int coco_set_shared_stacks(int k) {
+    struct worker *w = self != NULL ? self : &mainWorker;
+    if (k <= 0 || map_shared_stacks(w, k) != 0) {
+        return -1;
+    }
+    sharedStackCount = k;
+    w->nextSharedStack %= k;
+    return 0;
+}
+
+/**
+ * @brief the shared stack the next COCO_STACK_SHARED task runs on, each
+ * worker has its own set
+ *
+ * @return struct stack* the stack or NULL if none could be mapped
+ */
+static struct stack *next_shared_stack() {
+    if (sharedStackCount == 0 &&
+        coco_set_shared_stacks(DEFAULT_SHARED_STACKS) != 0) {
+        return NULL;
     }
+    if (map_shared_stacks(self, sharedStackCount) != 0) {
+        return NULL;
+    }
+    struct stack *s = self->sharedStacks[self->nextSharedStack];
+    self->nextSharedStack = (self->nextSharedStack + 1) % sharedStackCount;
+    return s;
+}
+
+/**
+ * @brief Make sure the task's frame is the one on its stack, copying out the
+ * frame of the task currently occupying it and copying in the task's own
+ * saved frame if it has one. A task alone on its stack never copies.
+ *
+ * @param[in] t the task about to run
+ */
+static void claim_stack(struct task *t) {
+    struct task_cold *c = t->cold;
+    struct stack *s = c->ctx.stack;
+    if (s->owner == t) {
+        return;
+    }
+    if (s->owner != NULL) {
+        struct task_cold *oc = s->owner->cold;
+        struct context *o = &oc->ctx;
+        ptrdiff_t stackSize = (char *)o->frameStart - (char *)o->frameEnd;
+        memcpy(frame_reserve(&oc->savedFrame, stackSize), o->frameEnd,
+               stackSize);
+        o->frameSize = stackSize;
+        self->copiedBytes += stackSize;
+        oc->counters.copiedBytes += stackSize;
+    }
+    if (c->ctx.frameSize > 0) {
+        memcpy(c->ctx.frameEnd, c->savedFrame.data, c->ctx.frameSize);
+        self->copiedBytes += c->ctx.frameSize;
+        c->counters.copiedBytes += c->ctx.frameSize;
+    }
+    s->owner = t;
+}
+
+/**
+ * @brief Make a task, without queueing it yet
+ *
+ * @param[in] w the worker it will run on
+ * @param[in] func the function to run for the task
+ * @param[in] args the arguments to pass to the function
+ * @param[in] list the queue it will run from
+ * @return struct task* the task, NULL if the table is full
+ */
+static struct task *new_task(struct worker *w, coroutine func, void *args,
+                             struct task *list) {
+    pthread_mutex_t *m = slots_lock(slot_owner(w));
+    take_lock(m);
+    struct task *node = alloc_task(w);
+    drop_lock(m);
+    if (node == NULL) {
+        return NULL;
+    }
+    init_task(node, func, args);
+    node->home = list;
+    node->worker = w;
+    node->prio = PRIO_DEFAULT;
+    node->cold->counters.readySince = self->lastTick;
+    trace_event(TRACE_SPAWN, tid_of(node), self->index, 0);
+    // with several workers, a shared stack is picked once it is clear which
+    // worker runs the task
+    node->sharedStack = stackMode == COCO_STACK_SHARED && threaded;
+    if (stackMode == COCO_STACK_SEPARATE) {
+        node->cold->ctx.stack = get_stack(node);
+    } else if (stackMode == COCO_STACK_SHARED && !node->sharedStack) {
+        node->cold->ctx.stack = next_shared_stack();
+    }
+    return node;
+}
+
+/**
+ * @brief Whether a task may still move to another worker: it hasn't started
+ * and isn't bound to one of this worker's shared stacks
+ *
+ */
+static inline bool can_move(struct task *t) {
+    struct stack *s = t->cold->ctx.stack;
+    return s == NULL || s == &t->cold->ownStack;
+}
+
+/**
+ * @brief Queue a task from new_task(). With more than one worker a new task
+ * that may move goes to this worker's spawned queue, where an idle worker
+ * can steal it.
+ *
+ * @param[in] t the task
+ * @return int its tid
+ */
+static int queue_task(struct task *t) {
+    int tid = tid_of(t); // it may be running elsewhere right after this
+    if (numWorkers == 1 || sharded || t->home == &self->dpcs ||
+        !can_move(t)) {
+        enqueue(t, true);
+        return tid;
+    }
+    pthread_mutex_lock(&self->lock);
+    cdll_insert(self->spawned.prev, t);
+    __atomic_store_n(&self->numSpawned, self->numSpawned + 1,
+                     __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&self->lock);
+    for (int i = 0; i < numWorkers; ++i) {
+        struct worker *w = workers[i];
+        if (w != self && __atomic_load_n(&w->idle, __ATOMIC_SEQ_CST)) {
+            wake_worker(w);
+            break;
+        }
+    }
+    return tid;
+}
+
+int add_task_to_queue(coroutine func, void *args, struct task *list) {
+    struct task *node = new_task(self, func, args, list);
+    return node != NULL ? queue_task(node) : 0;
+}
+
+/**
+ * @brief Add a task to the scheduler
+ *
+ * @param[in] func the function to run for the task
+ * @param[in] args the arguments to pass to the function
+ * @return int the tid of the task
+ */
+int add_task(coroutine func, void *args) {
+    return add_task_prio(func, args, PRIO_DEFAULT);
+}
+
+/**
+ * @brief Add a task at a priority level, with its arguments either passed
+ * by pointer or copied into it
+ *
+ * @param[in] func the function to run for the task
+ * @param[in] args the arguments to pass to the function, if src is NULL
+ * @param[in] src the arguments to copy into the task instead, or NULL
+ * @param[in] len the bytes at src
+ * @param[in] prio its priority level
+ * @return int the tid of the task, 0 if it can't be added
+ */
+static int spawn_task(coroutine func, void *args, const void *src, size_t len,
+                      int prio) {
+    // the DPC thread hands ordinary tasks to worker 0
+    struct worker *w = self == dpcWorker ? &mainWorker : self;
+    struct task *node = new_task(w, func, args, &w->levels[prio]);
+    if (node == NULL) {
+        return 0;
+    }
+    if (src != NULL) {
+        // big arguments come from the frame pool, so neither allocates once
+        // it is warm
+        struct task_cold *c = node->cold;
+        c->ctx.args = len <= TASK_INLINE_ARGS
+                          ? c->inlineArgs
+                          : frame_reserve(&c->argFrame, len);
+        memcpy(c->ctx.args, src, len);
+    }
+    node->prio = prio;
+    if (w != self) {
+        int tid = tid_of(node);
+        mailbox_push(node);
+        return tid;
+    }
+    return queue_task(node);
+}
+
+int add_task_prio(coroutine func, void *args, int prio) {
+    if (prio < 0 || prio >= PRIO_LEVELS) {
+        return 0;
+    }
+    return spawn_task(func, args, NULL, 0, prio);
+}
+
+int add_task_with_args(coroutine func, const void *src, size_t len) {
+    return spawn_task(func, NULL, src, len, PRIO_DEFAULT);
+}
+
+int add_task_on_stack(coroutine func, void *args, int stack) {
+    if (stack < 0 || (stack >= sharedStackCount &&
+                      coco_set_shared_stacks(stack + 1) != 0) ||
+        map_shared_stacks(self, sharedStackCount) != 0) {
+        return 0;
+    }
+    struct task *node =
+        new_task(self, func, args, &self->levels[PRIO_DEFAULT]);
+    if (node == NULL) {
+        return 0;
+    }
+    node->cold->ctx.stack = self->sharedStacks[stack];
+    node->sharedStack = false;
+    return queue_task(node);
+}
+
+/**
+ * @brief Add a task to the dpc queue
+ *
+ * @param[in] func the function to run for the task
+ * @param[in] args the arguments to pass to the function
+ * @return int the tid of the task
+ */
+int add_dpc(coroutine func, void *args) {
+    struct worker *w = dpcWorker != NULL ? dpcWorker : self;
+    struct task *node = new_task(w, func, args, &w->dpcs);
+    if (node == NULL) {
+        return 0;
+    }
+    node->cold->ctx.detached = true;
+    int tid = tid_of(node);
+    if (w == self) {
+        enqueue(node, false);
+    } else {
+        mailbox_push(node);
+    }
+    return tid;
+}
+
+/**
+ * @brief Run a single task that has already been started/
+ *
+ * @param[in] i the tid of the task to run
+ * @return enum task_status the status of said task after it yields
+ */
+enum task_status runTask(struct task *t) {
+    int ret;
+    if ((ret = coco_setjmp(t->cold->ctx.caller)) == 0) {
+        ctx = &t->cold->ctx;
+        if (ctx->stack != NULL) {
+            claim_stack(t);
+        }
+        if (ctx->keepSigmask) {
+            sigprocmask(SIG_SETMASK, &ctx->sigmask, NULL);
+        }
+        coco_longjmp(ctx->resumePoint, 0 + 1);
+    }
+    return ret;
+}
+
+/**
+ * @brief The bottom frame of a task running on its own stack
+ *
+ * @param[in] t the task to run
+ */
+static void __attribute__((noreturn, used)) task_entry(struct task *t) {
+    ctx->frameStart = t->cold->ctx.stack->base + t->cold->ctx.stack->size;
+    t->cold->func(ctx->args);
+    coco_exit(0);
+    __builtin_unreachable();
+}
+
+#if !(defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__)))
+#include <ucontext.h>
+static void task_entry_uc(void) { task_entry(currentTask); }
+#endif
+
+/**
+ * @brief Jump onto the top of a task's own stack and run it from there
+ *
+ * @param[in] t the task to run
+ */
+static void __attribute__((noreturn)) enter_stack(struct task *t) {
+    char *top = t->cold->ctx.stack->base + t->cold->ctx.stack->size;
+#if defined(__GNUC__) && defined(__x86_64__)
+    __asm__ volatile("mov %0, %%rsp\n\t"
+                     "xor %%ebp, %%ebp\n\t"
+                     "call *%1\n\t"
+                     "ud2"
+                     :
+                     : "r"(top), "r"(task_entry), "D"(t)
+                     : "memory");
+#elif defined(__GNUC__) && defined(__aarch64__)
+    __asm__ volatile("mov sp, %0\n\t"
+                     "mov x0, %2\n\t"
+                     "mov x29, xzr\n\t"
+                     "blr %1\n\t"
+                     "brk #0"
+                     :
+                     : "r"(top), "r"(task_entry), "r"(t)
+                     : "x0", "x29", "x30", "memory");
+#else
+    static ucontext_t boot, entry;
+    getcontext(&entry);
+    entry.uc_stack.ss_sp = t->cold->ctx.stack->base;
+    entry.uc_stack.ss_size = t->cold->ctx.stack->size;
+    entry.uc_link = NULL;
+    makecontext(&entry, task_entry_uc, 0);
+    swapcontext(&boot, &entry);
+#endif
+    __builtin_unreachable();
+}
+
+/**
+ * @brief Start a single task that has not already been started
+ *
+ * @param[in] i the tid of the task to start
+ * @return enum task_status the status of said task after it yields
+ */
+enum task_status startTask(struct task *t) {
+    int ret;
+    if ((ret = coco_setjmp(t->cold->ctx.caller)) == 0) {
+        ctx = &t->cold->ctx;
+        if (t->sharedStack) {
+            ctx->stack = next_shared_stack();
+        }
+        if (ctx->stack != NULL) {
+            claim_stack(t);
+            enter_stack(t);
+        }
+
+        defineSP();
+        ctx->frameStart = sp;
+        t->cold->func(ctx->args);
+        // if a task returns normally, just gracefully exit for it
+        // but assert that this should never happen in debug mode
+        coco_exit(0);
+    }
+    return ret;
+}
+
+void stopRunningTask() { currentTask->status = kStopped; coco_yield(); }
+
+/**
+ * @brief finish what a task that parked or exited could not do on its own
+ * frame: let go of the lock it switched out with and reap it if it exited
+ *
+ * @param[in] t the task
+ */
+static void __attribute__((noinline)) switched_out(struct task *t) {
+    if (t->status != kBlocked) {
+        coco_wake_all(&t->cold->exitWaiters);
+        if (t->status == kDead) {
+            free_task(t);
+        }
+    }
+    drop_lock(self->parkLock); // taken by coco_park()'s caller or coco_exit()
+}
+
+/**
+ * @brief switch to a task until it yields, sleeps, parks or exits
+ *
+ * @param[in] t the task, kNew or kYielding
+ */
+static inline void switch_to(struct task *t) {
+    currentTask = t;
+    // one clock read per switch: this one ends t's turn and starts the next
+    uint64_t start = self->lastTick;
+    struct task_counters *counters = &t->cold->counters;
+    if (start > counters->readySince) {
+        counters->readyTicks += start - counters->readySince;
+    }
+    trace_event(TRACE_RESUME, tid_of(t), self->index,
+                t->home == &self->dpcs);
+    enum task_status status = t->status == kNew ? startTask(t) : runTask(t);
+    trace_event(status == kYielding   ? TRACE_YIELD
+                : status == kSleeping ? TRACE_SLEEP
+                : status == kBlocked  ? TRACE_BLOCK
+                                      : TRACE_EXIT,
+                tid_of(t), self->index, t->cold->ctx.exitStatus);
+    uint64_t now = cpu_ticks();
+    self->lastTick = now;
+    counters->runTicks += now - start;
+    counters->readySince = now;
+    ++counters->resumes;
+    t->status = status;
+    if (status == kBlocked || status == kDone || status == kDead) {
+        switched_out(t);
+    }
+}
+
+/**
+ * @brief run the DPC FIFO until it is empty, or until a whole lap of what is
+ * left is stopped. A DPC goes to the back before it runs, so one that yields
+ * waits for the others and one that blocks or exits takes itself off.
+ *
+ * @return int how many DPCs were switched to
+ */
+static int drain_dpcs() {
+    struct task *q = &self->dpcs;
+    struct task *firstSkipped = NULL;
+    int ran = 0;
+    while (q->next != q && q->next != firstSkipped) {
+        struct task *t = q->next;
+        cdll_remove(t);
+        cdll_insert(q->prev, t);
+        if (__atomic_load_n(&t->stopped, __ATOMIC_RELAXED) ||
+            (t->status != kYielding && t->status != kNew)) {
+            if (firstSkipped == NULL) {
+                firstSkipped = t;
+            }
+            continue;
+        }
+        firstSkipped = NULL;
+        switch_to(t);
+        ++ran;
+    }
+    return ran;
+}
+
+/**
+ * @brief run the DPC queue until it is empty, checked before every task so
+ * the common empty case is a single compare
+ *
+ * @return int how many DPCs were switched to
+ */
+static inline int run_dpcs() {
+    return self->dpcs.next == &self->dpcs ? 0 : drain_dpcs();
+}
+
+int runDPCs() { return run_dpcs(); }
+
+/**
+ * @brief end worker 0's idle sleep from any thread or a signal handler,
+ * before coco_start() too. Async-signal-safe.
+ *
+ */
+static void wake_main() {
+    int fd = __atomic_load_n(&mainWakeFd, __ATOMIC_ACQUIRE);
+    if (fd >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(fd, &one, sizeof one);
+        (void)n;
+    }
+}
+
+/**
+ * @brief Where a bridged POSIX signal goes: a coco signal for a task, or a
+ * DPC. Written by the coco_bridge_signal functions and read by the
+ * scheduler under the runtime lock, never by the OS handler.
+ *
+ */
+struct signal_route {
+    int tid;        // The task to coco_kill(), 0 if none
+    enum sig sig;   // The coco signal to send it
+    coroutine func; // The DPC to add instead, NULL if none
+    void *args;
+};
+
+/**
+ * @brief POSIX signals caught but not yet delivered, a bounded ring many
+ * handlers may push to at once (one per thread, nested ones included) and
+ * worker 0 pops from. A slot's seq says whose turn it is: pos while it is
+ * free for the push at pos, pos + 1 once that push is published. A signal
+ * that finds the ring full is counted in overflow instead, so none is lost,
+ * only its order relative to other signals.
+ *
+ */
+static struct signal_route routes[NSIG];
+static struct {
+    unsigned seq;
+    int signo;
+} signalRing[SIGNAL_RING_SIZE];
+static unsigned ringHead, ringTail; // Next slot to pop and to push
+static unsigned overflow[NSIG];     // Signals that found the ring full
+static int signalsPending;          // Set by the handler, checked every pass
+
+/**
+ * @brief the handler of every bridged signal: queue it and wake worker 0.
+ * Only lock-free atomics and write(), so it is async-signal-safe.
+ *
+ */
+static void bridge_handler(int signo) {
+    int savedErrno = errno;
+    unsigned pos = __atomic_load_n(&ringTail, __ATOMIC_RELAXED);
+    for (;;) {
+        unsigned seq = __atomic_load_n(
+            &signalRing[pos % SIGNAL_RING_SIZE].seq, __ATOMIC_ACQUIRE);
+        int diff = (int)(seq - pos);
+        if (diff < 0) {
+            __atomic_add_fetch(&overflow[signo], 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (diff == 0 &&
+            __atomic_compare_exchange_n(&ringTail, &pos, pos + 1, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            signalRing[pos % SIGNAL_RING_SIZE].signo = signo;
+            __atomic_store_n(&signalRing[pos % SIGNAL_RING_SIZE].seq, pos + 1,
+                             __ATOMIC_RELEASE);
+            break;
+        }
+        if (diff > 0) {
+            pos = __atomic_load_n(&ringTail, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&signalsPending, 1, __ATOMIC_SEQ_CST);
+    wake_main();
+    errno = savedErrno;
+}
+
+/**
+ * @brief the DPC coco_bridge_signal() routes a signal through, so the coco
+ * handler runs in a task like with any other coco_kill()
+ *
+ */
+static void kill_route(void *arg) {
+    struct signal_route *r = arg;
+    coco_lock();
+    int tid = r->tid;
+    enum sig sig = r->sig;
+    coco_unlock();
+    if (tid != 0) {
+        coco_kill(tid, sig);
+    }
+    coco_exit(0);
+}
+
+/**
+ * @brief turn one caught signal into whatever its route says
+ *
+ */
+static void deliver_signal(int signo) {
+    coco_lock();
+    struct signal_route r = routes[signo];
+    coco_unlock();
+    if (r.func != NULL) {
+        add_dpc(r.func, r.args);
+    } else if (r.tid != 0) {
+        add_dpc(kill_route, &routes[signo]);
+    }
+}
+
+/**
+ * @brief deliver every signal caught since the last pass, oldest first. A
+ * push that is still being published when this runs sets signalsPending
+ * again once it is done, so it is picked up by the next pass.
+ *
+ */
+static void drain_signals() {
+    __atomic_store_n(&signalsPending, 0, __ATOMIC_SEQ_CST);
+    for (;;) {
+        unsigned pos = ringHead;
+        unsigned seq = __atomic_load_n(
+            &signalRing[pos % SIGNAL_RING_SIZE].seq, __ATOMIC_ACQUIRE);
+        if (seq != pos + 1) {
+            break;
+        }
+        int signo = signalRing[pos % SIGNAL_RING_SIZE].signo;
+        __atomic_store_n(&signalRing[pos % SIGNAL_RING_SIZE].seq,
+                         pos + SIGNAL_RING_SIZE, __ATOMIC_RELEASE);
+        ringHead = pos + 1;
+        deliver_signal(signo);
+    }
+    for (int signo = 1; signo < NSIG; ++signo) {
+        for (unsigned n = __atomic_exchange_n(&overflow[signo], 0,
+                                              __ATOMIC_RELAXED);
+             n > 0; --n) {
+            deliver_signal(signo);
+        }
+    }
+}
+
+/**
+ * @brief set up signo's route and install or remove the bridge handler
+ *
+ */
+static int bridge_signal(int signo, struct signal_route route) {
+    static bool ringReady = false;
+    if (signo <= 0 || signo >= NSIG || signo == SIGKILL || signo == SIGSTOP) {
+        return -1;
+    }
+    coco_lock();
+    if (!ringReady) {
+        for (unsigned i = 0; i < SIGNAL_RING_SIZE; ++i) {
+            signalRing[i].seq = i;
+        }
+        ringReady = true;
+    }
+    routes[signo] = route;
+    coco_unlock();
+    struct sigaction sa = {.sa_flags = SA_RESTART};
+    sa.sa_handler =
+        route.tid != 0 || route.func != NULL ? bridge_handler : SIG_DFL;
+    sigfillset(&sa.sa_mask);
+    return sigaction(signo, &sa, NULL);
+}
+
+int coco_bridge_signal(int signo, int tid, enum sig sig) {
+    if (sig < 0 || sig >= NUM_SIGNALS) {
+        return -1;
+    }
+    return bridge_signal(signo, (struct signal_route){.tid = tid, .sig = sig});
+}
+
+int coco_bridge_signal_dpc(int signo, coroutine func, void *args) {
+    return bridge_signal(signo,
+                         (struct signal_route){.func = func, .args = args});
+}
+
+/**
+ * @brief A task another OS thread asked for with coco_submit_from_thread().
+ * It can't take a task slot itself, since the table is only locked while
+ * several workers run, so worker 0 adds the task when it drains the queue.
+ *
+ */
+struct submission {
+    coroutine func;
+    void *args;
+    struct submission *next;
+};
+
+static struct submission *submitted; // Lock-free stack, pushed by any thread
+static struct submission *submitBacklog; // Drained but not added yet, oldest
+                                         // first, only worker 0 touches it
+
+int coco_submit_from_thread(coroutine func, void *args) {
+    struct submission *s = malloc(sizeof *s);
+    if (s == NULL) {
+        return -1;
+    }
+    s->func = func;
+    s->args = args;
+    struct submission *head = __atomic_load_n(&submitted, __ATOMIC_RELAXED);
+    do {
+        s->next = head;
+    } while (!__atomic_compare_exchange_n(&submitted, &head, s, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    // whoever pushed onto a non-empty stack wakes no one: the scheduler
+    // hasn't drained the one who found it empty yet, and that one wakes it
+    if (head == NULL) {
+        wake_main();
+    }
+    return 0;
+}
+
+/**
+ * @brief add a task for everything other threads submitted since the last
+ * pass, oldest first, in one batch. If the task table fills up the rest waits
+ * for a later pass.
+ *
+ */
+static void drain_submissions() {
+    struct submission *s = __atomic_exchange_n(&submitted, NULL,
+                                               __ATOMIC_ACQUIRE);
+    struct submission *oldest = NULL;
+    while (s != NULL) {
+        struct submission *next = s->next;
+        s->next = oldest;
+        oldest = s;
+        s = next;
+    }
+    struct submission **tail = &submitBacklog;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = oldest;
+    while ((s = submitBacklog) != NULL && add_task(s->func, s->args) != 0) {
+        submitBacklog = s->next;
+        free(s);
+    }
+}
+
+/**
+ * @brief move the tasks other threads handed this worker onto its queues and
+ * take the newer half of the tasks it spawned, leaving the older half for
+ * thieves
+ *
+ */
+static void take_work() {
+    struct worker *w = self;
+    if (__atomic_load_n(&w->mailbox, __ATOMIC_RELAXED) != NULL) {
+        mailbox_drain();
+    }
+    if (__atomic_load_n(&w->numSpawned, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&w->lock);
+    int n = (w->numSpawned + 1) / 2;
+    struct task *t = &w->spawned;
+    for (int i = 0; i < n; ++i) {
+        t = t->prev;
+    }
+    // newest first, like tasks added with one worker
+    while (t != &w->spawned) {
+        struct task *next = t->next;
+        cdll_remove(t);
+        enqueue(t, true);
+        t = next;
+    }
+    __atomic_store_n(&w->numSpawned, w->numSpawned - n, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * @brief take the older half of another worker's spawned tasks
+ *
+ * @return int how many tasks were taken
+ */
+static int steal() {
+    if (sharded) {
+        return 0;
+    }
+    for (int i = 1; i < numWorkers; ++i) {
+        struct worker *v = workers[(self->index + i) % numWorkers];
+        if (__atomic_load_n(&v->numSpawned, __ATOMIC_SEQ_CST) == 0) {
+            continue;
+        }
+        pthread_mutex_lock(&v->lock);
+        int n = (v->numSpawned + 1) / 2;
+        for (int k = 0; k < n; ++k) {
+            struct task *t = v->spawned.next;
+            cdll_remove(t);
+            t->worker = self;
+            t->home = &self->levels[t->prio];
+            enqueue(t, false);
+        }
+        __atomic_store_n(&v->numSpawned, v->numSpawned - n, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&v->lock);
+        if (n > 0) {
+            ++self->steals;
+            return n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief the runnable EDF task with the earliest deadline. Checked between
+ * best-effort tasks while the worker has EDF tasks, so a release is never
+ * late by more than one best-effort task's turn.
+ *
+ * @return struct task* the task, NULL if no EDF task is runnable
+ */
+static struct task *edf_ready() {
+    wake_sleepers();
+    struct task *q = &self->edf;
+    for (struct task *t = q->next; t != q; t = t->next) {
+        if (!__atomic_load_n(&t->stopped, __ATOMIC_RELAXED)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief run EDF tasks, earliest deadline first, for as long as any is
+ * runnable. Best-effort tasks only get the worker while none is.
+ *
+ * @return int how many tasks were switched to
+ */
+static inline int run_edf() {
+    if (self->numEdf == 0) {
+        return 0;
+    }
+    int ran = 0;
+    struct task *t;
+    while ((t = edf_ready()) != NULL) {
+        switch_to(t);
+        ran += 1 + run_dpcs();
+    }
+    return ran;
+}
+
+/**
+ * @brief pick the task to run after one switched out. If it woke a task of
+ * the same level, that one is pulled forward from wherever it is in the
+ * queue and goes next, while what it was waiting on is still in cache, up
+ * to RUN_NEXT_CHAIN tasks in a row; otherwise the queue goes on.
+ *
+ * @param[in] q the level's queue
+ * @param[in] next the task that would run next
+ * @return struct task* the task to run next
+ */
+static inline struct task *run_next(struct task *q, struct task *next) {
+    struct task *t = self->runNext;
+    self->runNext = NULL;
+    if (t == NULL || t->home != q || t->status != kYielding ||
+        __atomic_load_n(&t->stopped, __ATOMIC_RELAXED) ||
+        self->runChain >= RUN_NEXT_CHAIN) {
+        self->runChain = 0;
+        return next;
+    }
+    ++self->runChain;
+    if (t != next) {
+        cdll_remove(t);
+        cdll_insert(next->prev, t);
+    }
+    return t;
+}
+
+/**
+ * @brief run every task of one priority level once
+ *
+ * @param[in] l the level
+ * @return int how many tasks were switched to
+ */
+static int run_level(int l) {
+    struct task *q = &self->levels[l];
+    struct task *next = NULL;
+    int ran = 0;
+    for (struct task *t = q->next; t != q; t = next) {
+        ran += run_dpcs();
+        ran += run_edf();
+        next = t->next;
+        if (__atomic_load_n(&t->stopped, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        if (t->status == kYielding || t->status == kNew) {
+            self->runNext = NULL;
+            switch_to(t);
+            ++ran;
+            next = run_next(q, next);
+        }
+    }
+    if (q->next == q) {
+        self->nonEmpty &= ~(1u << l);
+    }
+    return ran;
+}
+
+/**
+ * @brief run all currently running tasks of the highest priority level that
+ * has any once. With aging on, a lower level that has waited agingPasses
+ * passes gets a pass of its own too.
+ *
+ * @return int how many tasks were switched to, 0 if nothing was runnable
+ */
+int runTasks() {
+    wake_sleepers();
+    if (threaded) {
+        take_work();
+    }
+    if (self == &mainWorker) {
+        if (__atomic_load_n(&signalsPending, __ATOMIC_RELAXED)) {
+            drain_signals();
+        }
+        if (__atomic_load_n(&submitted, __ATOMIC_RELAXED) != NULL ||
+            submitBacklog != NULL) {
+            drain_submissions();
+        }
+        reactor_poll();
+    }
+    int ran = run_dpcs();
+    ran += run_edf();
+    unsigned waiting = self->nonEmpty;
+    while (waiting != 0) {
+        int l = __builtin_ctz(waiting);
+        waiting &= waiting - 1;
+        self->passed[l] = 0;
+        // a level of only stopped tasks lets the next one run
+        int n = run_level(l);
+        ran += n;
+        if (n > 0) {
+            break;
+        }
+    }
+    for (; agingPasses > 0 && waiting != 0; waiting &= waiting - 1) {
+        int l = __builtin_ctz(waiting);
+        if (++self->passed[l] >= agingPasses) {
+            self->passed[l] = 0;
+            ran += run_level(l);
+        }
+    }
+    return ran;
+}
+
+void coco_set_prio_aging(unsigned passes) { agingPasses = passes; }
+
+/**
+ * @brief whether another thread handed this worker something to do, checked
+ * after it announced it is going idle so no hand off is missed
+ *
+ */
+static bool work_pending() {
+    if (__atomic_load_n(&self->mailbox, __ATOMIC_SEQ_CST) != NULL) {
+        return true;
+    }
+    for (int i = 0; i < numWorkers; ++i) {
+        // only a worker that may steal cares about the others' tasks
+        struct worker *w = sharded || self == dpcWorker ? self : workers[i];
+        if (__atomic_load_n(&w->numSpawned, __ATOMIC_SEQ_CST) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief block in the OS while no task is runnable, until the earliest
+ * sleeper is due, a descriptor a task waits on is ready, another worker hands
+ * this one work or someone calls coco_wakeup()
+ *
+ */
+static void idle_wait() {
+    struct worker *w = self;
+    struct timespec timeout, *tp = NULL;
+    uint64_t start = monotonic_ns();
+    uint64_t deadline = 0;
+    if (w->numTimers > 0) {
+        deadline = w->timers[0]->wakeAt;
+        if (deadline <= start) {
+            return;
+        }
+        timeout.tv_sec = (deadline - start) / 1000000000u;
+        timeout.tv_nsec = (deadline - start) % 1000000000u;
+        tp = &timeout;
+    }
+    if (threaded) {
+        __atomic_store_n(&w->idle, true, __ATOMIC_SEQ_CST);
+        if (work_pending()) {
+            __atomic_store_n(&w->idle, false, __ATOMIC_SEQ_CST);
+            return;
+        }
+    }
+    // tasks parked on I/O are woken by worker 0's next reactor_poll()
+    struct pollfd pfd[2] = {{.fd = w->wakeFd, .events = POLLIN},
+                            {.fd = w == &mainWorker ? reactor_fd() : -1,
+                             .events = POLLIN}};
+    int nfds = pfd[1].fd < 0 ? 1 : 2;
+    if (ppoll(pfd, nfds, tp, NULL) > 0 && (pfd[0].revents & POLLIN)) {
+        uint64_t count;
+        ssize_t n = read(w->wakeFd, &count, sizeof count);
+        (void)n;
+    }
+    __atomic_store_n(&w->idle, false, __ATOMIC_SEQ_CST);
+    uint64_t woke = monotonic_ns();
+    w->lastTick = cpu_ticks(); // the time asleep is no task's
+    ++w->idleStats.sleeps;
+    w->idleStats.idleNs += woke - start;
+    if (tp != NULL && woke >= deadline) {
+        uint64_t late = woke - deadline;
+        ++w->idleStats.timerWakeups;
+        w->idleStats.latencyNs += late;
+        if (late > w->idleStats.maxLatencyNs) {
+            w->idleStats.maxLatencyNs = late;
+        }
+    }
+}
+
+/**
+ * @brief the loop of every worker but worker 0, which runs its loop in
+ * coco_start() until the kernal exits
+ *
+ */
+static void *worker_main(void *arg) {
+    self = arg;
+    self->lastTick = cpu_ticks();
+    for (;;) {
+        if (runTasks() == 0 && (self == dpcWorker || steal() == 0)) {
+            idle_wait();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief put the DPC thread ahead of the workers in the OS scheduler, which
+ * takes privileges; without them it runs at normal priority
+ *
+ */
+static void raise_dpc_thread(struct worker *w) {
+    struct sched_param param = {.sched_priority = sched_get_priority_min(
+                                    SCHED_FIFO)};
+    pthread_setschedparam(w->thread, SCHED_FIFO, &param);
+}
+
+void reactor_kick() {
+    if (self != &mainWorker) {
+        wake_worker(&mainWorker);
+    }
+}
+
+void coco_wakeup() {
+    for (int i = 0; i < numThreads; ++i) {
+        wake_worker(workers[i]);
+    }
+}
+
+void coco_idle_stats(struct coco_idle_stats *out) {
+    *out = (struct coco_idle_stats){0};
+    for (int i = 0; i < numThreads; ++i) {
+        struct coco_idle_stats *s = &workers[i]->idleStats;
+        out->sleeps += s->sleeps;
+        out->idleNs += s->idleNs;
+        out->timerWakeups += s->timerWakeups;
+        out->latencyNs += s->latencyNs;
+        if (s->maxLatencyNs > out->maxLatencyNs) {
+            out->maxLatencyNs = s->maxLatencyNs;
+        }
+    }
+}
+
+void coco_frame_stats(struct coco_frame_stats *out) {
+    frame_stats(out);
+    out->copiedBytes = 0;
+    for (int i = 0; i < numThreads; ++i) {
+        out->copiedBytes += workers[i]->copiedBytes;
+    }
+}
+
+void coco_worker_stats(struct coco_worker_stats *out) {
+    out->workers = numWorkers;
+    out->steals = 0;
+    for (int i = 0; i < numWorkers; ++i) {
+        out->steals += __atomic_load_n(&workers[i]->steals, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief convert a task's counters for coco_task_stats()
+ *
+ */
+static void task_stats(const struct task_counters *c,
+                       struct coco_task_stats *out) {
+    out->resumes = c->resumes;
+    out->runNs = ticks_to_ns(c->runTicks);
+    out->readyNs = ticks_to_ns(c->readyTicks);
+    out->copiedBytes = c->copiedBytes;
+    out->peakFrameBytes = c->peakFrame;
+}
+
+int coco_task_stats(int tid, struct coco_task_stats *out) {
+    pthread_mutex_t *m = lock_tid(tid);
+    struct task *t = lookup_task(tid);
+    if (t != NULL) {
+        task_stats(&t->cold->counters, out);
+    }
+    drop_lock(m);
+    return t != NULL ? 0 : -1;
+}
+
+/**
+ * @brief add a task's counters to a sum
+ *
+ */
+static void add_counters(struct task_counters *sum,
+                         const struct task_counters *c) {
+    sum->resumes += c->resumes;
+    sum->runTicks += c->runTicks;
+    sum->readyTicks += c->readyTicks;
+    sum->copiedBytes += c->copiedBytes;
+    if (c->peakFrame > sum->peakFrame) {
+        sum->peakFrame = c->peakFrame;
+    }
+}
+
+void coco_runtime_stats(struct coco_runtime_stats *out) {
+    struct task_counters sum = {0};
+    out->liveTasks = 0;
+    // a worker's freed and live tasks under one hold of its lock, so a task
+    // freed meanwhile counts once
+    for (int w = 0; w < numThreads; ++w) {
+        take_lock(slots_lock(workers[w]));
+        add_counters(&sum, &workers[w]->retired);
+        int slots = __atomic_load_n(&numSlots, __ATOMIC_ACQUIRE);
+        for (int s = 0; s < slots / TASK_SLAB_SIZE; ++s) {
+            if (slabOwners[s] != workers[w]) {
+                continue;
+            }
+            for (int i = s == 0; i < TASK_SLAB_SIZE; ++i) {
+                struct task *t = &slabs[s][i];
+                if (t->status != kDead && t->status != kUDead) {
+                    ++out->liveTasks;
+                    add_counters(&sum, &t->cold->counters);
+                }
+            }
+        }
+        drop_lock(slots_lock(workers[w]));
+    }
+    task_stats(&sum, &out->tasks);
+    coco_idle_stats(&out->idle);
+    coco_frame_stats(&out->frames);
+    coco_worker_stats(&out->workers);
+}
+
+int coco_frame_report(const char *path) {
+    struct frame_profile *p = malloc(sizeof *p);
+    if (p == NULL) {
+        return -1;
+    }
+    unsigned long long yields[FRAME_HIST_BUCKETS] = {0};
+    memset(p, 0, sizeof *p);
+    for (int w = 0; w < numThreads; ++w) {
+        take_lock(slots_lock(workers[w]));
+        frame_profile_merge(p, &workers[w]->retiredFrames);
+        int slots = __atomic_load_n(&numSlots, __ATOMIC_ACQUIRE);
+        for (int s = 0; s < slots / TASK_SLAB_SIZE; ++s) {
+            if (slabOwners[s] != workers[w]) {
+                continue;
+            }
+            for (int i = s == 0; i < TASK_SLAB_SIZE; ++i) {
+                struct task *t = &slabs[s][i];
+                if (t->status != kDead && t->status != kUDead &&
+                    t->cold->counters.resumes != 0) {
+                    frame_profile_add(p, t->cold->func,
+                                      t->cold->counters.peakFrame);
+                }
+            }
+        }
+        drop_lock(slots_lock(workers[w]));
+    }
+    coco_lock();
+    for (int w = 0; w < numThreads; ++w) {
+        for (int b = 0; b < FRAME_HIST_BUCKETS; ++b) {
+            yields[b] += workers[w]->frameHist[b];
+        }
+    }
+    coco_unlock();
+    int ret = frame_profile_write(p, yields, path);
+    free(p);
+    return ret;
+}
+
+void coco_lock() { take_lock(&rtLock); }
+
+void coco_unlock() { drop_lock(&rtLock); }
+
+/**
+ * @brief the lock of objLocks an object's address picks
+ *
+ */
+static inline pthread_mutex_t *obj_lock(const void *obj) {
+    return &objLocks[(uintptr_t)obj / 64 % LOCK_STRIPES].m;
+}
+
+void coco_lock_on(const void *obj) { take_lock(obj_lock(obj)); }
+
+void coco_unlock_on(const void *obj) { drop_lock(obj_lock(obj)); }
+
+int coco_set_dpc_thread(int on) {
+    if (self != NULL) {
+        return -1;
+    }
+    dpcThreadWanted = on;
+    return 0;
+}
+
+int coco_set_workers(int n) {
+    if (n < 1 || n > MAX_WORKERS || self != NULL) {
+        return -1;
+    }
+    numWorkers = n;
+    numWorkersSet = true;
+    return 0;
+}
+
+int coco_set_shards(int n) {
+    if (coco_set_workers(n) != 0) {
+        return -1;
+    }
+    sharded = true;
+    return 0;
+}
+
+int coco_shard_id() { return self != NULL ? self->index : 0; }
+
+int coco_num_shards() { return numWorkers; }
+
+int coco_spawn_on(int shard, coroutine func, void *args) {
+    if (shard < 0 || shard >= numWorkers) {
+        return 0;
+    }
+    struct worker *w = workers[shard];
+    if (w == self) {
+        return add_task(func, args);
+    }
+    struct task *node = new_task(w, func, args, &w->levels[PRIO_DEFAULT]);
+    if (node == NULL) {
+        return 0;
+    }
+    int tid = tid_of(node);
+    mailbox_push(node);
+    return tid;
+}
+
+/**
+ * @brief keep a shard on one CPU, best effort
+ *
+ */
+static void pin_worker(struct worker *w) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->index % (cpus > 0 ? cpus : 1), &set);
+    pthread_setaffinity_np(w->thread, sizeof set, &set);
+}
+
+/**
+ * @brief Get the Status of a task
+ *
+ * @param[in] tid the id of the task
+ * @return enum task_status representing said status
+ */
+enum task_status getStatus(int tid) {
+    pthread_mutex_t *m = lock_tid(tid);
+    struct task *t = lookup_task(tid);
+    enum task_status status = t == NULL ? kDead
+                              : t->stopped && t->status == kYielding
+                                  ? kStopped
+                                  : t->status;
+    drop_lock(m);
+    return status;
+}
+
+/**
+ * @brief: Get the Context of a task
+ *
+ * @param[in]: tid the id of the task
+ * return: struct context*
+ */
+struct context *getContext(int tid) {
+    pthread_mutex_t *m = lock_tid(tid);
+    struct task *t = lookup_task(tid);
+    drop_lock(m);
+    return t != NULL ? &t->cold->ctx : NULL;
+}
+
+/**
+ * @brief set up a worker's queues and its wake up descriptor
+ *
+ */
+static void init_worker(struct worker *w, int index) {
+    struct task *lists[] = {&w->dpcs, &w->spawned, &w->edf};
+    for (size_t i = 0; i < sizeof lists / sizeof *lists; ++i) {
+        lists[i]->next = lists[i];
+        lists[i]->prev = lists[i];
+    }
+    for (int l = 0; l < PRIO_LEVELS; ++l) {
+        w->levels[l].next = &w->levels[l];
+        w->levels[l].prev = &w->levels[l];
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    w->freeTasks.next = &w->freeTasks;
+    w->freeTasks.prev = &w->freeTasks;
+    pthread_mutex_init(&w->slotLock, NULL);
+    w->index = index;
+    w->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+void coco_start(coroutine kernal, void *args) {
+    int texit = 0;
+    sigprocmask(SIG_SETMASK, NULL, &schedulerMask);
+    const char *env = getenv("COCO_SHARDS");
+    sharded |= !numWorkersSet && env != NULL;
+    if (!sharded) {
+        env = getenv("COCO_WORKERS");
+    }
+    if (!numWorkersSet && env != NULL) {
+        int n = atoi(env);
+        numWorkers = n < 1 ? 1 : n > MAX_WORKERS ? MAX_WORKERS : n;
+    }
+    env = getenv("COCO_DPC_THREAD");
+    dpcThreadWanted |= env != NULL && atoi(env) != 0;
+    numThreads = numWorkers + dpcThreadWanted;
+    threaded = numThreads > 1;
+    if (threaded) {
+        // the DPC thread, if any, comes last
+        workers = calloc(numThreads, sizeof *workers);
+        assert(workers != NULL && "Out of memory for the workers");
+        workers[0] = &mainWorker;
+        for (int i = 1; i < numThreads; ++i) {
+            workers[i] = calloc(1, sizeof **workers);
+            assert(workers[i] != NULL && "Out of memory for the workers");
+        }
+    }
+    for (int i = 0; i < numThreads; ++i) {
+        init_worker(workers[i], i);
+    }
+    for (int i = 0; i < LOCK_STRIPES; ++i) {
+        pthread_mutex_init(&objLocks[i].m, NULL);
+    }
+    if (dpcThreadWanted) {
+        dpcWorker = workers[numWorkers];
+    }
+    self = &mainWorker;
+    startNs = monotonic_ns();
+    startTicks = cpu_ticks();
+    trace_start();
+    mainWorker.lastTick = startTicks;
+    __atomic_store_n(&mainWakeFd, mainWorker.wakeFd, __ATOMIC_RELEASE);
+    // worker threads start with the scheduler's signal mask
+    for (int i = 1; i < numThreads; ++i) {
+        int err = pthread_create(&workers[i]->thread, NULL, worker_main,
+                                 workers[i]);
+        assert(err == 0 && "Could not start a worker");
+        (void)err;
+    }
+    mainWorker.thread = pthread_self();
+    if (dpcWorker != NULL) {
+        raise_dpc_thread(dpcWorker);
+    }
+    for (int i = 0; sharded && i < numWorkers; ++i) {
+        pin_worker(workers[i]);
+    }
+    const char *mode = getenv("COCO_STACK_MODE");
+    if (!stackModeSet && mode != NULL) {
+        stackMode = strcmp(mode, "separate") == 0 ? COCO_STACK_SEPARATE
+                    : strcmp(mode, "shared") == 0 ? COCO_STACK_SHARED
+                                                  : COCO_STACK_COPY;
+    }
+    // the kernal stays on this thread, which checks on it every pass
+    struct task *k =
+        new_task(self, (coroutine)kernal, args, &self->levels[PRIO_DEFAULT]);
+    enqueue(k, true);
+    // a detached kernal can't be reaped, it just exits 0
+    for (int kernalid = tid_of(k);
+         coco_waitpid(kernalid, &texit, COCO_WNOHANG) == 0;) {
+        if (runTasks() == 0 && steal() == 0) {
+            idle_wait();
+        }
+    }
+    const char *tracePath = getenv("COCO_TRACE_FILE");
+    if (tracePath != NULL) {
+        coco_trace_flush(tracePath);
+    }
+    const char *framePath = getenv("COCO_FRAME_REPORT");
+    if (framePath != NULL) {
+        coco_frame_report(framePath);
+    }
+    exit(texit);
+}
+
+/**
+ * @brief copy the running task's frame out of the shared scheduler stack. A
+ * task on its own stack only records where its frame ends, it gets copied
+ * lazily by claim_stack() if the stack is ever shared.
+ *
+ */
+#define saveStack()                                                            \
+    do {                                                                       \
+        defineSP();                                                            \
+        ctx->frameEnd = sp;                                                    \
+        ptrdiff_t stackSize = (char *)ctx->frameStart - (char *)sp;            \
+        struct task_counters *counters = &currentTask->cold->counters;         \
+        if ((unsigned long long)stackSize > counters->peakFrame) {             \
+            counters->peakFrame = stackSize;                                   \
+        }                                                                      \
+        ++self->frameHist[frame_bucket(stackSize)];                            \
+        if (ctx->stack == NULL) {                                              \
+            memcpy(frame_reserve(&currentTask->cold->savedFrame, stackSize),   \
+                   sp, stackSize);                                             \
+            ctx->frameSize = stackSize;                                        \
+            self->copiedBytes += stackSize;                                    \
+            counters->copiedBytes += stackSize;                                \
+        }                                                                      \
+    } while (0)
+
+#define restoreStack()                                                         \
+    do {                                                                       \
+        if (ctx->stack == NULL) {                                              \
+            memcpy(ctx->frameEnd, currentTask->cold->savedFrame.data,          \
+                   ctx->frameSize);                                            \
+            self->copiedBytes += ctx->frameSize;                               \
+            currentTask->cold->counters.copiedBytes += ctx->frameSize;         \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @brief hand the scheduler its signal mask back before switching out of a
+ * task that keeps its own
+ *
+ * @param[in] save whether to remember the task's mask for when it resumes
+ */
+static inline void release_sigmask(bool save) {
+    if (ctx->keepSigmask) {
+        sigprocmask(SIG_SETMASK, &schedulerMask, save ? &ctx->sigmask : NULL);
+    }
+}
+
+void coco_keep_sigmask(int keep) {
+    if (!keep && ctx->keepSigmask) {
+        sigprocmask(SIG_SETMASK, &schedulerMask, NULL);
+    }
+    ctx->keepSigmask = keep;
+}
+
+void coco_yield() {
+    if (!can_yield) {
+        assert(false && "Can't yield here");
+    }
+    saveStack();
+    if (coco_setjmp(ctx->resumePoint) == 0) {
+        release_sigmask(true);
+        coco_longjmp(ctx->caller, kYielding);
+    } else {
+    }
+    restoreStack();
+}
+
+/**
+ * @brief sleep in the timer heap until a CLOCK_MONOTONIC deadline
+ *
+ * @param[in] wakeAt the deadline in ns
+ */
+static void sleep_until(uint64_t wakeAt) {
+    if (!can_yield) {
+        assert(false && "Can't yield here");
+    }
+    saveStack();
+    currentTask->wakeAt = wakeAt;
+    cdll_remove(currentTask);
+    timer_add(currentTask);
+    if (coco_setjmp(ctx->resumePoint) == 0) {
+        release_sigmask(true);
+        coco_longjmp(ctx->caller, kSleeping);
+    } else {
+    }
+    restoreStack();
+}
+
+void yieldForMs(unsigned int ms) {
+    sleep_until(monotonic_ns() + (uint64_t)ms * 1000000u);
+}
+inline void yieldForS(unsigned int s) { yieldForMs(s * 1000); }
+
+int coco_set_edf(unsigned periodUs, unsigned deadlineUs) {
+    struct task *t = currentTask;
+    if (periodUs == 0) {
+        if (t->period != 0) {
+            --self->numEdf;
+            t->period = 0;
+            cdll_remove(t);
+            t->home = &self->levels[t->prio];
+            enqueue(t, false);
+        }
+        return 0;
+    }
+    if (deadlineUs == 0 || deadlineUs > periodUs) {
+        return -1;
+    }
+    self->numEdf += t->period == 0;
+    t->period = (uint64_t)periodUs * 1000u;
+    t->relDeadline = (uint64_t)deadlineUs * 1000u;
+    t->release = monotonic_ns();
+    t->deadline = t->release + t->relDeadline;
+    // it is running, so it is runnable: it goes where its deadline says
+    cdll_remove(t);
+    t->home = &self->edf;
+    enqueue(t, false);
+    return 0;
+}
+
+void coco_edf_wait() {
+    struct task *t = currentTask;
+    assert(t->period != 0 && "Not an EDF task");
+    uint64_t now = monotonic_ns();
+    struct coco_edf_stats *stats = &t->cold->edfStats;
+    ++stats->jobs;
+    if (now > t->deadline) {
+        ++stats->misses;
+        if (now - t->deadline > stats->maxLatenessNs) {
+            stats->maxLatenessNs = now - t->deadline;
+        }
+    }
+    t->release += t->period;
+    t->deadline = t->release + t->relDeadline;
+    if (t->release > now) {
+        sleep_until(t->release);
+        return;
+    }
+    // behind: the next job is already released, with its later deadline
+    cdll_remove(t);
+    enqueue(t, false);
+    coco_yield();
+}
+
+int coco_edf_stats(int tid, struct coco_edf_stats *out) {
+    pthread_mutex_t *m = lock_tid(tid);
+    struct task *t = lookup_task(tid);
+    if (t != NULL) {
+        *out = t->cold->edfStats;
+    }
+    drop_lock(m);
+    return t != NULL ? 0 : -1;
+}
+
+void coco_waitq_init(struct coco_waitq *q) {
+    q->head = NULL;
+    q->tail = NULL;
+}
+
+/**
+ * @brief coco_park() for a queue guarded by m rather than the runtime lock
+ *
+ */
+static void park_with(struct coco_waitq *q, pthread_mutex_t *m) {
+    if (!can_yield) {
+        assert(false && "Can't yield here");
+    }
+    self->parkLock = m;
+    saveStack();
+    // the task is off its run queue so its list links are free to chain the
+    // wait queue with
+    cdll_remove(currentTask);
+    currentTask->next = NULL;
+    if (q->tail != NULL) {
+        q->tail->next = currentTask;
+    } else {
+        q->head = currentTask;
+    }
+    q->tail = currentTask;
+    if (coco_setjmp(ctx->resumePoint) == 0) {
+        release_sigmask(true);
+        coco_longjmp(ctx->caller, kBlocked);
+    } else {
+    }
+    restoreStack();
+    take_lock(m);
+}
+
+void coco_park(struct coco_waitq *q) { park_with(q, &rtLock); }
+
+void coco_park_on(struct coco_waitq *q, const void *obj) {
+    park_with(q, obj_lock(obj));
+}
+
+int coco_waitpid(int tid, int *exitStatus, int options) {
+    int ret = -1;
+    struct task *t;
+    pthread_mutex_t *m = lock_tid(tid);
+    while ((t = lookup_task(tid)) != NULL) {
+        if (t->status == kDone) {
+            t->status = kDead;
+            if (exitStatus != NULL) {
+                *exitStatus = t->cold->ctx.exitStatus;
+            }
+            free_task(t);
+            ret = tid;
+            break;
+        }
+        if (options & COCO_WNOHANG) {
+            ret = 0;
+            break;
+        }
+        park_with(&t->cold->exitWaiters, m);
+    }
+    drop_lock(m);
+    return ret;
+}
+
+int coco_wake_one(struct coco_waitq *q) {
+    struct task *t = q->head;
+    if (t == NULL) {
+        return 0;
+    }
+    q->head = t->next;
+    if (q->head == NULL) {
+        q->tail = NULL;
+    }
+    make_runnable(t);
+    // a handoff: it runs as soon as the waker switches out, see run_next()
+    if (t->worker == self && self->runNext == NULL) {
+        self->runNext = t;
+    }
+    return 1;
+}
+
+void coco_wake_all(struct coco_waitq *q) {
+    while (coco_wake_one(q)) {
+    }
+}
+
+void coco_detach() { ctx->detached = true; }
+
+void coco_exit(unsigned int stat) {
+    if (!can_yield) {
+        assert(false && "Can't yield here");
+    }
+    ctx->exitStatus = stat;
+    coco_setjmp(ctx->resumePoint);
+    if (ctx->stack != NULL && ctx->stack->owner == currentTask) {
+        ctx->stack->owner = NULL;
+    }
+    cdll_remove(currentTask);
+    if (currentTask->period != 0) {
+        --self->numEdf;
+    }
+    release_sigmask(false);
+    // held until the scheduler has woken the waiters, see switch_to()
+    self->parkLock = task_lock(currentTask);
+    take_lock(self->parkLock);
+    coco_longjmp(ctx->caller, ctx->detached ? kDead : kDone);
+}
+
+int coco_fork() {
+    pthread_mutex_t *m = slots_lock(slot_owner(self));
+    take_lock(m);
+    struct task *childTask = alloc_task(self);
+    if (childTask != NULL) {
+        // the copied frame points at the parent's copied arguments, keep
+        // them where they are for as long as the child lives
+        struct task_cold *pc = currentTask->cold;
+        struct task *owner = pc->argOwner;
+        if (owner == NULL && (ctx->args == pc->inlineArgs ||
+                              (ctx->args != NULL &&
+                               ctx->args == pc->argFrame.data))) {
+            owner = currentTask;
+        }
+        childTask->cold->argOwner = owner;
+        if (owner != NULL) {
+            ++owner->cold->argReaders;
+        }
+    }
+    drop_lock(m);
+    if (childTask == NULL) {
+        return -1;
+    }
+    volatile int tid = tid_of(childTask);
+    // it starts mid frame, so it stays on this worker
+    childTask->status = kYielding;
+    childTask->prio = currentTask->prio;
+    childTask->period = 0; // a forked child starts out best effort
+    childTask->cold->edfStats = (struct coco_edf_stats){0};
+    childTask->cold->counters = (struct task_counters){0};
+    // it profiles as its parent
+    childTask->cold->func = currentTask->cold->func;
+    trace_event(TRACE_SPAWN, tid, self->index, 0);
+    childTask->home = &self->levels[childTask->prio];
+    childTask->worker = self;
+    enqueue(childTask, true);
+    childTask->stopped = false;
+    coco_waitq_init(&childTask->cold->exitWaiters);
+
+    // The child starts out as a copy of the parent's frame at the same
+    // addresses, either on the scheduler stack or sharing the parent's stack
+    struct context *child = &childTask->cold->ctx;
+    memcpy(child, ctx, sizeof(struct context));
+    defineSP();
+    ptrdiff_t stackSize = (char *)ctx->frameStart - (char *)sp;
+    memcpy(frame_reserve(&childTask->cold->savedFrame, stackSize), sp,
+           stackSize);
+    self->copiedBytes += stackSize;
+    child->frameSize = stackSize;
+    child->frameEnd = sp;
+    if (coco_setjmp(child->resumePoint) != 0) {
+        restoreStack();
+        return 0;
+    }
+    return tid;
+}
+
+int coco_kill(int tid, enum sig signal) {
+    if (signal < 0 || signal >= NUM_SIGNALS) {
+        return -1;
+    }
+    pthread_mutex_t *m = lock_tid(tid);
+    struct task *t = lookup_task(tid);
+    signalHandler handler = t != NULL ? t->cold->ctx.handlers[signal] : NULL;
+    drop_lock(m);
+    if (t == NULL) {
+        return -1;
+    }
+    trace_event(TRACE_KILL, tid, self->index, signal);
+    can_yield = false;
+    handler();
+    can_yield = true;
+    // the scheduler skips stopped tasks, a sleeping or blocked task stays
+    // where it is and wakes up stopped
+    switch (signal) {
+    case COCO_SIGSTP:
+        __atomic_store_n(&t->stopped, true, __ATOMIC_RELAXED);
+        break;
+    case COCO_SIGCONT:
+        __atomic_store_n(&t->stopped, false, __ATOMIC_RELAXED);
+        if (t->worker != self) {
+            wake_worker(t->worker);
+        }
+        break;
+    default:
+        break;
+    }
+    return 0;
 }
 
 int coco_sigaction(enum sig sig, signalHandler handler) {
@@ -21,7 +21,6 @@
 #pragma once
 
 #include <assert.h> ///< exit
-#include <setjmp.h> ///< setjmp and longjmp
 #include <stddef.h> ///< get ptrdiff_t for stack saving
 #include <stdio.h>  ///< fprintf
 #include <string.h> ///< memcpy
@@ -29,10 +28,6 @@
 
 #include "coco_config.h"
 
-#define setjmp(x) sigsetjmp(x,1)
-#define longjmp siglongjmp
-#define jmp_buf sigjmp_buf
-
 /**
  * Type: coroutine
  * A coroutine (thread/process) is a function that can be paused and resumed
@@ -63,15 +58,342 @@ typedef void (*coroutine)(void *);
  */
 void coco_start(coroutine kernal, void *args);
 
+/**
+ * Enum: coco_stack_mode
+ * Where a task's stack frames live while it is paused.
+ *
+ * - COCO_STACK_COPY: the task runs on the scheduler's stack and its frame is
+ *   copied out on every yield and back in on every resume
+ * - COCO_STACK_SEPARATE: the task runs on its own mmap'd stack (with a guard
+ *   page) and a switch only swaps registers
+ * - COCO_STACK_SHARED: the task runs on one of a few shared stacks (see
+ *   coco_set_shared_stacks) and its frame is only copied when a different
+ *   task needs that stack
+ */
+enum coco_stack_mode {
+    COCO_STACK_COPY,
+    COCO_STACK_SEPARATE,
+    COCO_STACK_SHARED,
+};
+
+/**
+ * @brief: Choose the stack mode for tasks added from now on. Tasks that
+ * already exist keep the mode they were started with. Before coco_start the
+ * default comes from COCO_SEPARATE_STACKS at build time, overridable by
+ * setting the COCO_STACK_MODE environment variable to "copy", "separate" or
+ * "shared".
+ *
+ * @param[in]: mode the stack mode
+ */
+void coco_set_stack_mode(enum coco_stack_mode mode);
+
+/**
+ * @brief: Set up k shared stacks for COCO_STACK_SHARED tasks, which are
+ * spread over them round robin unless placed with add_task_on_stack. Without
+ * a call, the first shared task sets up DEFAULT_SHARED_STACKS. Stacks are
+ * never unmapped, so asking for fewer only stops new tasks landing on the
+ * rest.
+ *
+ * @param[in]: k the number of stacks
+ * return: 0, or -1 if a stack could not be mapped
+ */
+int coco_set_shared_stacks(int k);
+
+/**
+ * @brief: Adds a task that runs on a given shared stack. Tasks that take
+ * turns (a producer and its consumer) switch without copying anything if
+ * they are put on different stacks.
+ *
+ * @param[in]: func the function that the task will run
+ * @param[in]: args arguments to said function
+ * @param[in]: stack the shared stack, from 0 to k - 1
+ * return: the tid of the added task or 0 if task can't be added
+ */
+int add_task_on_stack(coroutine func, void *args, int stack);
+
+/**
+ * Struct: coco_idle_stats
+ * How the scheduler spent the time when no task was runnable.
+ */
+struct coco_idle_stats {
+    unsigned long long sleeps;       // times the scheduler blocked in the OS
+    unsigned long long idleNs;       // total time spent blocked
+    unsigned long long timerWakeups; // sleeps that ended at a timer deadline
+    unsigned long long latencyNs;    // total lateness of those wake ups
+    unsigned long long maxLatencyNs; // worst lateness of those wake ups
+};
+
+/**
+ * @brief: Get a snapshot of the idle statistics
+ *
+ * @param[out]: out where to store them
+ */
+void coco_idle_stats(struct coco_idle_stats *out);
+
+/**
+ * Struct: coco_frame_stats
+ * How much memory saved stack frames take. Frames come from size classes of
+ * 256 B to 64 KiB, bigger ones get a buffer of their own.
+ */
+struct coco_frame_stats {
+    unsigned long long usedBytes;     // Held by tasks
+    unsigned long long cachedBytes;   // Free in the pool, ready for reuse
+    unsigned long long peakUsedBytes; // Most ever held by tasks at once
+    unsigned long long copiedBytes;   // Copied off and back onto stacks
+};
+
+/**
+ * @brief: Get a snapshot of the saved-frame memory statistics
+ *
+ * @param[out]: out where to store them
+ */
+void coco_frame_stats(struct coco_frame_stats *out);
+
+/**
+ * @brief: Wake the scheduler if it is blocked in the OS waiting for a task
+ * to become runnable. Async-signal-safe and callable from any thread.
+ */
+void coco_wakeup();
+
+/**
+ * @brief: Ask for a task from an OS thread that isn't running coco, e.g. a
+ * blocking client pool handing its results back. The request goes on a
+ * lock-free queue and wakes worker 0, which adds the task at the top of its
+ * next pass. Callable from any thread, before coco_start too; from inside a
+ * task, use add_task.
+ *
+ * @param[in]: func the function to run for the task
+ * @param[in]: args the arguments to pass to the function
+ * return: 0, or -1 if out of memory
+ */
+int coco_submit_from_thread(coroutine func, void *args);
+
+/**
+ * @brief: Run tasks on n scheduler threads (workers) instead of one. Must be
+ * called before coco_start; the COCO_WORKERS environment variable is used
+ * otherwise. Each worker has its own run queue and sleepers. New tasks are
+ * queued on the worker that added them and idle workers steal the ones
+ * that haven't started yet; a task that has started stays on its worker.
+ * With more than one worker, tasks that share plain data must use coco's
+ * channels, semaphores and waitgroups (or coco_lock) to synchronize.
+ *
+ * @param[in]: n the number of workers, 1 (the default) to MAX_WORKERS
+ * return: 0, or -1 if n is out of range or the scheduler already started
+ */
+int coco_set_workers(int n);
+
+/**
+ * @brief: Like coco_set_workers, but the workers are shards: each is pinned
+ * to a CPU, never steals, and only runs tasks spawned on it, either by its
+ * own tasks or through coco_spawn_on. Each shard hands out task slots from
+ * slabs of its own under a lock of its own, so spawning, exiting and reaping
+ * on one shard don't contend with the others. The COCO_SHARDS environment
+ * variable is used if it isn't called.
+ *
+ * @param[in]: n the number of shards, 1 to MAX_WORKERS
+ * return: 0, or -1 if n is out of range or the scheduler already started
+ */
+int coco_set_shards(int n);
+
+/**
+ * @brief: The worker (shard) running the calling task, 0 with one worker
+ */
+int coco_shard_id();
+
+/**
+ * @brief: The number of workers (shards)
+ */
+int coco_num_shards();
+
+/**
+ * @brief: Add a task on a given worker (shard). The task is handed over
+ * through the worker's lock-free mailbox and can be waited on from any
+ * shard with coco_waitpid.
+ *
+ * @param[in]: shard the worker, 0 to coco_num_shards() - 1
+ * @param[in]: func the function that the task will run
+ * @param[in]: args arguments to said function
+ * return: the tid of the added task or 0 if it can't be added
+ */
+int coco_spawn_on(int shard, coroutine func, void *args);
+
+/**
+ * @brief: Run DPCs on a thread of their own instead of between the tasks of
+ * each worker, so they don't add latency between every pair of tasks. The
+ * thread gets SCHED_FIFO if the process may set it. Must be called before
+ * coco_start; the COCO_DPC_THREAD environment variable is used otherwise.
+ *
+ * @param[in]: on whether to
+ * return: 0, or -1 if the scheduler already started
+ */
+int coco_set_dpc_thread(int on);
+
+/**
+ * Struct: coco_worker_stats
+ * How work was spread over the workers.
+ */
+struct coco_worker_stats {
+    int workers;              // Scheduler threads
+    unsigned long long steals; // Times an idle worker took another's tasks
+};
+
+/**
+ * @brief: Get a snapshot of the worker statistics
+ *
+ * @param[out]: out where to store them
+ */
+void coco_worker_stats(struct coco_worker_stats *out);
+
+/**
+ * Struct: coco_task_stats
+ * Where a task's time and copying went. Times are taken once per switch, so
+ * run time includes the scheduler's work switching to the task, and ready
+ * time is exact to within one other task's turn.
+ */
+struct coco_task_stats {
+    unsigned long long resumes;        // Times it was switched to
+    unsigned long long runNs;          // Time it ran
+    unsigned long long readyNs;        // Time it was runnable, not running
+    unsigned long long copiedBytes;    // Its frame copied off and back on
+    unsigned long long peakFrameBytes; // Largest frame it switched out with
+};
+
+/**
+ * @brief: Get a task's counters, also after it exited until reaped. Always
+ * on; a task running on another worker is read without stopping it.
+ *
+ * @param[in]: tid the task
+ * @param[out]: out where to store them
+ * return: 0, or -1 if tid names no task
+ */
+int coco_task_stats(int tid, struct coco_task_stats *out);
+
+/**
+ * Struct: coco_runtime_stats
+ * A snapshot of the whole runtime.
+ */
+struct coco_runtime_stats {
+    unsigned long long liveTasks;  // Tasks not reaped yet, DPCs included
+    struct coco_task_stats tasks;  // Summed over every task there has been,
+                                   // peakFrameBytes is the largest
+    struct coco_idle_stats idle;
+    struct coco_frame_stats frames;
+    struct coco_worker_stats workers;
+};
+
+/**
+ * @brief: Get a snapshot of the whole runtime
+ *
+ * @param[out]: out where to store it
+ */
+void coco_runtime_stats(struct coco_runtime_stats *out);
+
+/**
+ * @brief: Write the last TRACE_RING_SIZE scheduling events (spawns, wake
+ * ups, resumes, yields, sleeps, blocks, exits, kills) as Chrome trace-event
+ * JSON that Perfetto or chrome://tracing can load: a track per worker with
+ * a slice per turn of a task, and the time each task waited runnable as
+ * "ready" slices. Needs coco built with COCO_TRACE; then a kernal that
+ * exits also writes the file COCO_TRACE_FILE names, if it is set.
+ *
+ * @param[in]: path the file to write
+ * return: 0, or -1 if it can't be written or tracing is compiled out
+ */
+int coco_trace_flush(const char *path);
+
+/**
+ * @brief: Write a stack-frame profile to help size frames: a histogram of
+ * how big task frames were each time one was switched out, and for each
+ * task entry function how many tasks ran it, their median and largest peak
+ * frame, and a frame budget with headroom for it. Tasks still alive count
+ * once they have run. A kernal that exits also writes the file
+ * COCO_FRAME_REPORT names, if it is set.
+ *
+ * @param[in]: path the file to write, "-" for stderr
+ * return: 0, or -1 if it can't be written
+ */
+int coco_frame_report(const char *path);
+
+/**
+ * @brief: Take the runtime lock. With more than one worker, code that parks
+ * and wakes tasks (pools, I/O) holds it from checking its condition until it
+ * calls coco_park or coco_wake_*, so no wake up is lost. coco_park lets go of
+ * it while the task is parked and takes it back before returning. Not
+ * recursive; a no-op with one worker.
+ */
+void coco_lock();
+
+/**
+ * @brief: Let go of the runtime lock
+ */
+void coco_unlock();
+
+/**
+ * @brief: Like coco_lock, but take one of LOCK_STRIPES locks picked by an
+ * object's address, for code whose wait queues live in that object.
+ * Channels, semaphores and waitgroups use it, so tasks on different shards
+ * using different objects don't contend for the runtime lock. Park with
+ * coco_park_on while holding it.
+ *
+ * @param[in]: obj the object
+ */
+void coco_lock_on(const void *obj);
+
+/**
+ * @brief: Let go of the lock coco_lock_on(obj) took
+ */
+void coco_unlock_on(const void *obj);
+
 /**
  * @brief: Adds a task to the scheduler
  * ingroup: functions
  * @param[in]: func the function that the task will run
  * @param[in]: args arguments to said function
  * return: the tid of the added task or 0 if task can't be added
+ *
+ * note: a reaped tid is refused by coco_waitpid and coco_kill until its slot
+ * has been reused 2^(31 - TID_INDEX_BITS) (2048) times; then the tid comes
+ * round again. Freed slots are reused oldest first, so that takes at least
+ * 2048 times as many spawns as there are free slots in the table.
  */
 int add_task(coroutine func, void *args);
 
+/**
+ * @brief: Adds a task that gets its own copy of its arguments, so the caller
+ * needn't keep them alive. Up to TASK_INLINE_ARGS bytes are kept in the task
+ * itself, bigger arguments in a pooled buffer; either way the task's args
+ * pointer stays valid until it is reaped. Children it forks share the copy,
+ * which then stays valid until they are reaped too.
+ *
+ * @param[in]: func the function that the task will run
+ * @param[in]: src the arguments to copy
+ * @param[in]: len their size in bytes
+ * return: the tid of the added task or 0 if task can't be added
+ */
+int add_task_with_args(coroutine func, const void *src, size_t len);
+
+/**
+ * @brief: Adds a task at a priority level. Each pass the scheduler runs the
+ * tasks of the highest level that has runnable ones, round robin, and lower
+ * levels wait (see coco_set_prio_aging). DPCs still run before everything.
+ *
+ * @param[in]: func the function that the task will run
+ * @param[in]: args arguments to said function
+ * @param[in]: prio the level, 0 (highest) to PRIO_LEVELS - 1; add_task uses
+ * PRIO_DEFAULT
+ * return: the tid of the added task or 0 if task can't be added
+ */
+int add_task_prio(coroutine func, void *args, int prio);
+
+/**
+ * @brief: Age waiting priority levels: a level that had runnable tasks but
+ * was passed over this many scheduler passes in a row gets a pass anyway, so
+ * low priority work slows down instead of starving.
+ *
+ * @param[in]: passes the number of passes, 0 (the default) turns aging off
+ */
+void coco_set_prio_aging(unsigned passes);
+
 /**
  * @brief: stop the currently running task
  *
@@ -88,7 +410,8 @@ void stopRunningTask();
  * @param[in]: opts waitpid option bit vector
  * @param[out]: exitStatus a pointer to where the exit status can be stored
  *
- * return: the tid of the reaped task (0 zero if no task was reaped)
+ * return: the tid of the reaped task, 0 if it hasn't exited yet (with
+ * COCO_WNOHANG) or -1 if tid names no task, e.g. it was already reaped
  */
 int coco_waitpid(int tid, int *exitStatus, int options);
 #define coco_wait(tid) coco_waitpid(tid, NULL, WNOOPT)
@@ -119,6 +442,16 @@ void yieldForS(unsigned int s);
  */
 void coco_exit(unsigned int stat);
 
+/**
+ * @brief: Save the calling task's signal mask when it switches out and
+ * restore it when it switches back in, the way sigsetjmp(x, 1) would. Off by
+ * default: it costs a sigprocmask syscall on every switch, and tasks that
+ * leave it off all share the scheduler's mask.
+ *
+ * @param[in]: keep nonzero to start keeping the mask, zero to stop
+ */
+void coco_keep_sigmask(int keep);
+
 /**
  * @brief Automatically reap this task when it exits
  *
@@ -135,12 +468,73 @@ void coco_detach();
  */
 int add_dpc(coroutine func, void *args);
 
+struct task;
+
+/**
+ * Struct: coco_waitq
+ * An intrusive FIFO of tasks blocked on some object (a channel, semaphore,
+ * ...). A parked task is off the run queue entirely and costs nothing until
+ * whoever satisfies it wakes it.
+ */
+struct coco_waitq {
+    struct task *head;
+    struct task *tail;
+};
+
+/**
+ * @brief: initialize an empty wait queue
+ *
+ * @param[in]: q the queue
+ */
+void coco_waitq_init(struct coco_waitq *q);
+
+/**
+ * @brief: block the running task on a wait queue until it is woken. Like a
+ * condition variable, the woken task should re-check what it waited for.
+ * With more than one worker, call it holding coco_lock; it returns holding
+ * it again.
+ *
+ * @param[in]: q the queue to wait on
+ */
+void coco_park(struct coco_waitq *q);
+
+/**
+ * @brief: coco_park for a queue guarded by coco_lock_on(obj) instead of the
+ * runtime lock
+ *
+ * @param[in]: q the queue to wait on
+ * @param[in]: obj the object whose lock the caller holds
+ */
+void coco_park_on(struct coco_waitq *q, const void *obj);
+
+/**
+ * @brief: make the task that has waited longest on a queue runnable again
+ *
+ * @param[in]: q the queue
+ * return: 1 if a task was woken, 0 if nobody was waiting
+ */
+int coco_wake_one(struct coco_waitq *q);
+
+/**
+ * @brief: make every task waiting on a queue runnable again
+ *
+ * @param[in]: q the queue
+ */
+void coco_wake_all(struct coco_waitq *q);
+
 /**
  * @brief a while loop that yields to the OS every iteration
  * 
  */
 #define coco_while(cond) for (; cond; coco_yield())
 
+/**
+ * @brief: Duplicate the running task. The child resumes from the same point
+ * with a copy of the parent's frame.
+ *
+ * return: the child's tid in the parent, 0 in the child, -1 if the task
+ * table is full
+ */
 int coco_fork();
 
 typedef void (*signalHandler)(void);
@@ -154,4 +548,73 @@ enum sig {
 
 int coco_sigaction(enum sig sig, signalHandler handler);
 
-void coco_kill(int tid, enum sig signal);
\ No newline at end of file
+/**
+ * @brief: Send a signal to a task
+ *
+ * @param[in]: tid the task
+ * @param[in]: signal the signal
+ * return: 0, or -1 if tid names no task (e.g. it was already reaped)
+ */
+int coco_kill(int tid, enum sig signal);
+
+/**
+ * @brief: Put the running task in the earliest-deadline-first class, for
+ * soft real-time loops. Its first job is released now; each job ends with
+ * coco_edf_wait(). While any of a worker's EDF tasks is runnable the worker
+ * runs the one whose job is due first, and its best-effort tasks wait.
+ *
+ * @param[in]: periodUs microseconds between job releases, 0 to go back to
+ * best effort
+ * @param[in]: deadlineUs microseconds from a release to the job's deadline,
+ * at most periodUs
+ * return: 0, or -1 if the deadline is 0 or longer than the period
+ */
+int coco_set_edf(unsigned periodUs, unsigned deadlineUs);
+
+/**
+ * @brief: End the running EDF task's current job and sleep until the next
+ * one is released. A job that ends past its deadline counts as a miss.
+ */
+void coco_edf_wait();
+
+/**
+ * @brief: Deadline statistics of an EDF task
+ */
+struct coco_edf_stats {
+    unsigned long long jobs;          // Jobs ended with coco_edf_wait()
+    unsigned long long misses;        // Of those, ended past their deadline
+    unsigned long long maxLatenessNs; // Worst time past a deadline
+};
+
+/**
+ * @brief: Get a task's EDF statistics, also after it exited until reaped
+ *
+ * @param[in]: tid the task
+ * @param[out]: out where to store them
+ * return: 0, or -1 if tid names no task
+ */
+int coco_edf_stats(int tid, struct coco_edf_stats *out);
+
+/**
+ * @brief: Bridge a POSIX signal into coco: whenever signo reaches the
+ * process, on any thread, worker 0 sends sig to task tid with coco_kill()
+ * from a DPC. The OS handler only queues signo and wakes the scheduler, so
+ * it is async-signal-safe; handlers still never run inside a signal.
+ *
+ * @param[in]: signo the POSIX signal, e.g. SIGTERM
+ * @param[in]: tid the task, 0 to stop bridging signo and restore SIG_DFL
+ * @param[in]: sig the coco signal to send it
+ * return: 0, or -1 if signo can't be caught or sig is out of range
+ */
+int coco_bridge_signal(int signo, int tid, enum sig sig);
+
+/**
+ * @brief: Bridge a POSIX signal to a DPC: whenever signo reaches the process
+ * worker 0 adds func as a DPC, once per signal received.
+ *
+ * @param[in]: signo the POSIX signal
+ * @param[in]: func the DPC to add, NULL to stop bridging signo
+ * @param[in]: args the arguments to pass it
+ * return: 0, or -1 if signo can't be caught
+ */
+int coco_bridge_signal_dpc(int signo, coroutine func, void *args);
\ No newline at end of file
@@ -0,0 +1,46 @@
+/**
+ * @file coco_clock.h
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief The clocks the scheduler reads: CLOCK_MONOTONIC for deadlines and
+ * the cycle counter for what is timed on every switch
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief the current CLOCK_MONOTONIC time
+ *
+ * @return uint64_t nanoseconds
+ */
+static inline uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief the cycle counter where there is one (rdtsc, cntvct_el0), else
+ * CLOCK_MONOTONIC. Its rate is only known by comparing it with
+ * monotonic_ns() over a while.
+ *
+ * @return uint64_t ticks
+ */
+static inline uint64_t cycle_ticks() {
+#if defined(__GNUC__) && defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return monotonic_ns();
+#endif
+}
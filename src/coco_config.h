@@ -11,17 +11,54 @@
 
 #pragma once
 
-#define MAX_TASKS (1 << 8)
-#define USR_CTX_SIZE (1 << 12) // Max size of user data context segment
+#define TID_INDEX_BITS 20 // Bits of a tid that index the task table
+#define MAX_TASKS (1 << TID_INDEX_BITS) // The task table grows up to this
+#define TASK_SLAB_SIZE (1 << 10) // Tasks allocated at once as the table grows
+#define FRAME_MIN_SIZE (1 << 8) // Smallest saved-frame size class
+#define FRAME_CLASSES 5 // Saved-frame size classes, each 4x the last
+#define FRAME_POOL_KEEP 64 // Free saved frames of each class kept for reuse
+#define TASK_INLINE_ARGS 64 // Argument bytes add_task_with_args() keeps in the task
+#define POOL_INDEX_BITS 16 // Bits of a pool job handle that index its job slots
+#define TASK_STACK_SIZE (1 << 16) // Size of a task's own stack in separate mode
+#define DEFAULT_SHARED_STACKS 4 // Shared stacks set up if nobody asks for k
+#define MAX_WORKERS 256 // Most scheduler threads coco_set_workers() allows
+#define LOCK_STRIPES 64 // Locks coco_lock_on() spreads objects over
+#define PRIO_LEVELS 8   // Task priority levels, 0 is the highest (at most 32)
+#define PRIO_DEFAULT 4  // The level add_task() uses
+#define PRIO_AGING_PASSES 0 // Default for coco_set_prio_aging(), 0 is off
+#define RUN_NEXT_CHAIN 3 // Woken tasks run right after their waker this many
+                         // times in a row before the queue goes on, 0 is off
+#define SIGNAL_RING_SIZE 64 // POSIX signals queued in order (a power of 2)
+#define TASK_CLOCK 1 // Time every switch for coco_task_stats(), 0 to skip
+#define TRACE_RING_SIZE (1 << 16) // Events kept with COCO_TRACE, newest win
+#define FRAME_PROFILE_FUNCS 256 // Entry functions coco_frame_report() tells apart
 
-#define CLOCKS_TO_MS (1000.0 / CLOCKS_PER_SEC)
+/**
+ * @brief the stack mode new tasks get unless coco_set_stack_mode() or the
+ * COCO_STACK_MODE environment variable say otherwise
+ *
+ */
+#ifdef COCO_SEPARATE_STACKS
+#define DEFAULT_STACK_MODE COCO_STACK_SEPARATE
+#else
+#define DEFAULT_STACK_MODE COCO_STACK_COPY
+#endif
 
-// #define defineSP() register void * sp; asm volatile("mov %0, sp" : "=r"(sp))
-#define defineSP() register void * sp = __builtin_frame_address(0)
 /**
  * @brief functions and include to get the stack pointer for stack saving
  *
+ * The real stack pointer is needed, not the frame address: locals spilled
+ * below the frame pointer are part of the frame that has to be saved.
  */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define defineSP()                                                             \
+    void *sp;                                                                  \
+    __asm__ volatile("mov %%rsp, %0" : "=r"(sp))
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define defineSP()                                                             \
+    void *sp;                                                                  \
+    __asm__ volatile("mov %0, sp" : "=r"(sp))
+#endif
 #if !defined(defineSP) &&                                                         \
     (defined(WIN32) || defined(__WIN32) || defined(__WIN32__))
 #include <malloc.h>
@@ -0,0 +1,250 @@
+/**
+ * @file coco_frames.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Definitions for the saved-frame pool. Each class keeps a free list
+ * threaded through the free buffers themselves, capped at FRAME_POOL_KEEP
+ * buffers so the pool shrinks back after a burst. Each worker thread has its
+ * own free lists; the statistics are shared.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE ///< dladdr
+#include "coco_frames.h"
+#include "coco.h"
+#include "coco_config.h"
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define class_size(c) ((size_t)FRAME_MIN_SIZE << 2 * (c)) // 4x per class
+#define FRAME_MAX_SIZE class_size(FRAME_CLASSES - 1)
+
+static __thread char *freeFrames[FRAME_CLASSES]; // Link through first word
+static __thread int numFree[FRAME_CLASSES];
+static struct coco_frame_stats stats; // Only touched through atomics
+
+#define stat_add(field, n) __atomic_add_fetch(&stats.field, n, __ATOMIC_RELAXED)
+#define stat_sub(field, n) __atomic_sub_fetch(&stats.field, n, __ATOMIC_RELAXED)
+#define stat_get(field) __atomic_load_n(&stats.field, __ATOMIC_RELAXED)
+
+/**
+ * @brief the smallest class that fits size bytes
+ *
+ * @return int the class, FRAME_CLASSES if none does
+ */
+static int class_of(size_t size) {
+    int c = 0;
+    for (size_t cap = FRAME_MIN_SIZE; cap < size && c < FRAME_CLASSES;
+         cap <<= 2) {
+        ++c;
+    }
+    return c;
+}
+
+/**
+ * @brief the class a buffer was allocated from
+ *
+ * @return int the class, FRAME_CLASSES if it was sized to fit
+ */
+static int class_of_capacity(size_t capacity) {
+    return capacity > FRAME_MAX_SIZE ? FRAME_CLASSES : class_of(capacity);
+}
+
+char *frame_reserve(struct frame *f, size_t size) {
+    int want = class_of(size);
+    if (f->data != NULL) {
+        int have = class_of_capacity(f->capacity);
+        if (f->capacity >= size && have <= want + 1) {
+            return f->data;
+        }
+        frame_release(f);
+    }
+    // oversized frames round up to the largest class, so growing a little
+    // deeper doesn't mean a new buffer every time
+    size_t capacity = want < FRAME_CLASSES
+                          ? class_size(want)
+                          : (size + FRAME_MAX_SIZE - 1) & ~(FRAME_MAX_SIZE - 1);
+    if (want < FRAME_CLASSES && freeFrames[want] != NULL) {
+        f->data = freeFrames[want];
+        freeFrames[want] = *(char **)f->data;
+        --numFree[want];
+        stat_sub(cachedBytes, capacity);
+    } else {
+        f->data = malloc(capacity);
+        assert(f->data != NULL && "Out of memory for saved stack frames");
+    }
+    f->capacity = capacity;
+    unsigned long long used = stat_add(usedBytes, f->capacity);
+    unsigned long long peak = stat_get(peakUsedBytes);
+    while (used > peak &&
+           !__atomic_compare_exchange_n(&stats.peakUsedBytes, &peak, used,
+                                        1, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+    return f->data;
+}
+
+void frame_release(struct frame *f) {
+    if (f->data == NULL) {
+        return;
+    }
+    int c = class_of_capacity(f->capacity);
+    stat_sub(usedBytes, f->capacity);
+    if (c < FRAME_CLASSES && numFree[c] < FRAME_POOL_KEEP) {
+        *(char **)f->data = freeFrames[c];
+        freeFrames[c] = f->data;
+        ++numFree[c];
+        stat_add(cachedBytes, f->capacity);
+    } else {
+        free(f->data);
+    }
+    f->data = NULL;
+    f->capacity = 0;
+}
+
+void frame_stats(struct coco_frame_stats *out) {
+    out->usedBytes = stat_get(usedBytes);
+    out->cachedBytes = stat_get(cachedBytes);
+    out->peakUsedBytes = stat_get(peakUsedBytes);
+}
+
+/**
+ * @brief the entry of a profile for an entry function, taking a free one if
+ * it has none yet
+ *
+ */
+static struct frame_profile_entry *entry_of(struct frame_profile *p,
+                                            void (*func)(void *)) {
+    size_t h = ((uintptr_t)func >> 4) % FRAME_PROFILE_FUNCS;
+    for (int i = 0; i < FRAME_PROFILE_FUNCS; ++i) {
+        struct frame_profile_entry *slot =
+            &p->funcs[(h + i) % FRAME_PROFILE_FUNCS];
+        if (slot->func == func || slot->func == NULL) {
+            slot->func = func;
+            return slot;
+        }
+    }
+    return &p->other;
+}
+
+void frame_profile_add(struct frame_profile *p, void (*func)(void *),
+                       size_t peak) {
+    struct frame_profile_entry *e = entry_of(p, func);
+    ++e->tasks;
+    ++e->peaks[frame_bucket(peak)];
+    if (peak > e->peak) {
+        e->peak = peak;
+    }
+}
+
+/**
+ * @brief add one profile entry's tasks to another
+ *
+ */
+static void merge_entry(struct frame_profile_entry *e,
+                        const struct frame_profile_entry *from) {
+    e->tasks += from->tasks;
+    for (int b = 0; b < FRAME_HIST_BUCKETS; ++b) {
+        e->peaks[b] += from->peaks[b];
+    }
+    if (from->peak > e->peak) {
+        e->peak = from->peak;
+    }
+}
+
+void frame_profile_merge(struct frame_profile *p,
+                         const struct frame_profile *from) {
+    for (int i = 0; i < FRAME_PROFILE_FUNCS; ++i) {
+        if (from->funcs[i].func != NULL) {
+            merge_entry(entry_of(p, from->funcs[i].func), &from->funcs[i]);
+        }
+    }
+    merge_entry(&p->other, &from->other);
+}
+
+/**
+ * @brief the frame budget to give tasks that peaked at peak: a quarter more
+ * for headroom, rounded up to the pool class it will come from, or to whole
+ * largest classes past the biggest one
+ *
+ */
+static size_t budget_of(size_t peak) {
+    size_t want = peak + peak / 4;
+    int c = class_of(want);
+    return c < FRAME_CLASSES
+               ? class_size(c)
+               : (want + FRAME_MAX_SIZE - 1) & ~(FRAME_MAX_SIZE - 1);
+}
+
+/**
+ * @brief print one entry function's line of the report
+ *
+ */
+static void write_entry(FILE *f, const struct frame_profile_entry *e,
+                        const char *name) {
+    char addr[32];
+    Dl_info info;
+    if (name == NULL) {
+        if (dladdr((void *)e->func, &info) != 0 && info.dli_sname != NULL &&
+            info.dli_saddr == (void *)e->func) {
+            name = info.dli_sname;
+        } else {
+            snprintf(addr, sizeof addr, "%p", (void *)e->func);
+            name = addr;
+        }
+    }
+    // the bucket half the tasks stay under
+    unsigned long long seen = 0;
+    int median = 0;
+    while (median < FRAME_HIST_BUCKETS - 1 &&
+           (seen += e->peaks[median]) * 2 < e->tasks) {
+        ++median;
+    }
+    fprintf(f, "%-32s %10llu %12zu %12zu %12zu\n", name, e->tasks,
+            median == 0 ? 0 : (size_t)1 << median, e->peak,
+            budget_of(e->peak));
+}
+
+int frame_profile_write(const struct frame_profile *p,
+                        const unsigned long long *yields, const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    unsigned long long total = 0;
+    for (int b = 0; b < FRAME_HIST_BUCKETS; ++b) {
+        total += yields[b];
+    }
+    fprintf(f, "coco frame report: %llu frames saved\n\n", total);
+    fprintf(f, "%-32s %10s %8s\n", "frame size when saved", "frames", "share");
+    for (int b = 0; b < FRAME_HIST_BUCKETS; ++b) {
+        if (yields[b] != 0) {
+            char range[32];
+            snprintf(range, sizeof range, "<= %zu B", (size_t)1 << b);
+            fprintf(f, "%-32s %10llu %7.1f%%\n", range, yields[b],
+                    100.0 * yields[b] / total);
+        }
+    }
+    fprintf(f, "\n%-32s %10s %12s %12s %12s\n", "entry function", "tasks",
+            "median <= B", "peak B", "budget B");
+    for (int i = 0; i < FRAME_PROFILE_FUNCS; ++i) {
+        if (p->funcs[i].func != NULL) {
+            write_entry(f, &p->funcs[i], NULL);
+        }
+    }
+    if (p->other.tasks != 0) {
+        write_entry(f, &p->other, "(other)");
+    }
+    fprintf(f, "\nbudget: the peak plus a quarter, rounded up to its frame "
+               "pool class (largest %zu B)\n",
+            (size_t)FRAME_MAX_SIZE);
+    return f == stderr ? 0 : fclose(f) == 0 ? 0 : -1;
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+/**
+ * @file coco_frames.h
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Size-classed pool for the stack frames tasks save while switched
+ * out. A task holds a buffer of the smallest class its frame fits, and moves
+ * to another class when its frame outgrows or shrinks well below it.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "coco_config.h"
+
+struct coco_frame_stats;
+
+#define FRAME_HIST_BUCKETS 32 // Bucket b counts sizes in (2^(b-1), 2^b]
+
+/**
+ * @brief the histogram bucket of a frame size
+ *
+ */
+static inline int frame_bucket(size_t size) {
+    int b = size <= 1 ? 0 : 64 - __builtin_clzll(size - 1);
+    return b < FRAME_HIST_BUCKETS ? b : FRAME_HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief the peak frames of the tasks that ran one entry function
+ *
+ */
+struct frame_profile_entry {
+    void (*func)(void *); // NULL for a free slot
+    unsigned long long tasks;
+    size_t peak;
+    unsigned long long peaks[FRAME_HIST_BUCKETS]; // Of its tasks, by bucket
+};
+
+/**
+ * @brief peak frames by entry function, an open-addressed table on the
+ * function's address. Functions past FRAME_PROFILE_FUNCS share other.
+ *
+ */
+struct frame_profile {
+    struct frame_profile_entry funcs[FRAME_PROFILE_FUNCS];
+    struct frame_profile_entry other;
+};
+
+/**
+ * @brief a saved-frame buffer
+ *
+ */
+struct frame {
+    char *data;      // The buffer, NULL if none is held
+    size_t capacity; // Its size in bytes
+};
+
+/**
+ * @brief make sure a buffer can hold size bytes, trading it for another
+ * class if it is too small or at least two classes too big. Frames bigger
+ * than the largest class get a buffer of their own.
+ *
+ * @param[in,out] f the buffer
+ * @param[in] size the bytes it has to hold
+ * @return char* the buffer's data
+ */
+char *frame_reserve(struct frame *f, size_t size);
+
+/**
+ * @brief give a buffer back to the pool
+ *
+ * @param[in,out] f the buffer, left empty
+ */
+void frame_release(struct frame *f);
+
+/**
+ * @brief fill in the pool's counters
+ *
+ */
+void frame_stats(struct coco_frame_stats *out);
+
+/**
+ * @brief count a task's peak frame against its entry function
+ *
+ * @param[in,out] p the profile
+ * @param[in] func the task's entry function
+ * @param[in] peak the largest frame it switched out with, in bytes
+ */
+void frame_profile_add(struct frame_profile *p, void (*func)(void *),
+                       size_t peak);
+
+/**
+ * @brief add the tasks counted in one profile to another
+ *
+ * @param[in,out] p the profile to add to
+ * @param[in] from the profile to add
+ */
+void frame_profile_merge(struct frame_profile *p,
+                         const struct frame_profile *from);
+
+/**
+ * @brief write the frame report: the sizes frames had when they were saved,
+ * and per entry function its tasks' peaks and a frame budget
+ *
+ * @param[in] p the profile
+ * @param[in] yields frames saved at yield time, by frame_bucket()
+ * @param[in] path the file to write, "-" for stderr
+ * @return int 0, or -1 if it can't be written
+ */
+int frame_profile_write(const struct frame_profile *p,
+                        const unsigned long long *yields, const char *path);
@@ -0,0 +1,53 @@
+/**
+ * @file coco_jmp.h
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Register-only context save/restore used to switch between tasks.
+ * Like _setjmp/_longjmp: the signal mask is never touched, so a switch makes
+ * no syscalls.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#if defined(__GNUC__) && defined(__ELF__) &&                                   \
+    (defined(__x86_64__) || defined(__aarch64__))
+
+#include <stdint.h>
+
+#if defined(__x86_64__)
+// rbx, rbp, r12-r15, rsp, return address
+typedef uintptr_t coco_jmp_buf[8];
+#else
+// x19-x30, sp, d8-d15
+typedef uintptr_t coco_jmp_buf[22];
+#endif
+
+/**
+ * @brief save the callee-saved registers, stack pointer and return address
+ *
+ * @param[out] buf where to save them
+ * @return 0 when saving, the value passed to coco_longjmp when resumed
+ */
+int coco_setjmp(coco_jmp_buf buf) __attribute__((returns_twice));
+
+/**
+ * @brief resume a context saved by coco_setjmp
+ *
+ * @param[in] buf the saved context
+ * @param[in] val what coco_setjmp returns, 0 is turned into 1
+ */
+void coco_longjmp(coco_jmp_buf buf, int val) __attribute__((noreturn));
+
+#else
+
+#include <setjmp.h>
+
+#define coco_jmp_buf jmp_buf
+#define coco_setjmp(x) _setjmp(x)
+#define coco_longjmp _longjmp
+
+#endif
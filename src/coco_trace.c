@@ -0,0 +1,180 @@
+/**
+ * @file coco_trace.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Definition of the context-switch trace ring and its JSON writer
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "coco_trace.h"
+#include "coco.h"
+#include "coco_clock.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef COCO_TRACE
+
+/**
+ * @brief one event. seq is written last, the event's position in the ring
+ * plus one, so coco_trace_flush() can tell a finished slot apart from one
+ * that is being overwritten.
+ *
+ */
+struct trace_entry {
+    uint64_t ticks;
+    int tid;
+    int arg;
+    unsigned short kind;
+    unsigned short worker;
+    unsigned seq;
+};
+
+static struct trace_entry ring[TRACE_RING_SIZE];
+static uint64_t head;              // Position of the next event
+static uint64_t startTicks, startNs; // cycle_ticks() and the time at start
+
+void trace_start() {
+    startNs = monotonic_ns();
+    startTicks = cycle_ticks();
+}
+
+void trace_event(enum trace_kind kind, int tid, int worker, int arg) {
+    uint64_t pos = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    struct trace_entry *e = &ring[pos % TRACE_RING_SIZE];
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->ticks = cycle_ticks();
+    e->tid = tid;
+    e->arg = arg;
+    e->kind = kind;
+    e->worker = worker;
+    __atomic_store_n(&e->seq, (unsigned)(pos + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief copy an event out of the ring
+ *
+ * @return bool false if it was being written or already overwritten
+ */
+static bool read_event(uint64_t pos, struct trace_entry *out) {
+    struct trace_entry *e = &ring[pos % TRACE_RING_SIZE];
+    if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != (unsigned)(pos + 1)) {
+        return false;
+    }
+    *out = *e;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&e->seq, __ATOMIC_RELAXED) == (unsigned)(pos + 1);
+}
+
+/**
+ * @brief the fields every JSON event has: one process, a track per worker
+ *
+ */
+#define WHERE "\"pid\":1,\"ts\":%.3f,\"tid\":%d"
+
+/**
+ * @brief the start ("b") or end ("e") of the async slice a task spends
+ * runnable, keyed by its tid
+ *
+ */
+#define READY(ph)                                                              \
+    "{\"name\":\"ready\",\"cat\":\"queue\",\"ph\":\"" ph "\",\"id\":%d," WHERE   \
+    "},\n"
+
+int coco_trace_flush(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    uint64_t dt = cycle_ticks() - startTicks;
+    double usPerTick = dt == 0 ? 1e-3 : (monotonic_ns() - startNs) / 1e3 / dt;
+    // a slice whose start was overwritten is left out, one still running
+    // is closed at the last event
+    static bool open[MAX_WORKERS + 1];
+    static const char *outs[] = {[TRACE_YIELD] = "yield",
+                                 [TRACE_SLEEP] = "sleep",
+                                 [TRACE_BLOCK] = "block",
+                                 [TRACE_EXIT] = "exit"};
+    double ts = 0;
+    int workers = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (uint64_t pos = begin; pos < end; ++pos) {
+        struct trace_entry e;
+        if (!read_event(pos, &e) || e.worker > MAX_WORKERS) {
+            continue;
+        }
+        ts = (double)(int64_t)(e.ticks - startTicks) * usPerTick;
+        workers = e.worker >= workers ? e.worker + 1 : workers;
+        switch (e.kind) {
+        case TRACE_SPAWN:
+        case TRACE_WAKE:
+            fprintf(f,
+                    "{\"name\":\"%s %d\",\"ph\":\"i\",\"s\":\"t\"," WHERE
+                    "},\n",
+                    e.kind == TRACE_SPAWN ? "spawn" : "wake", e.tid, ts,
+                    e.worker);
+            // how long it then waits in the run queue
+            fprintf(f, READY("b"), e.tid, ts, e.worker);
+            break;
+        case TRACE_RESUME:
+            fprintf(f, READY("e"), e.tid, ts, e.worker);
+            fprintf(f,
+                    "{\"name\":\"%s %d\",\"cat\":\"run\",\"ph\":\"B\"," WHERE
+                    ",\"args\":{\"tid\":%d}},\n",
+                    e.arg ? "dpc" : "task", e.tid, ts, e.worker, e.tid);
+            open[e.worker] = true;
+            break;
+        case TRACE_YIELD:
+        case TRACE_SLEEP:
+        case TRACE_BLOCK:
+        case TRACE_EXIT:
+            if (!open[e.worker]) {
+                break;
+            }
+            open[e.worker] = false;
+            fprintf(f, "{\"ph\":\"E\"," WHERE ",\"args\":{\"out\":\"%s\"", ts,
+                    e.worker, outs[e.kind]);
+            if (e.kind == TRACE_EXIT) {
+                fprintf(f, ",\"status\":%d", e.arg);
+            }
+            fprintf(f, "}},\n");
+            if (e.kind == TRACE_YIELD) {
+                fprintf(f, READY("b"), e.tid, ts, e.worker);
+            }
+            break;
+        case TRACE_KILL:
+            fprintf(f,
+                    "{\"name\":\"kill %d\",\"ph\":\"i\",\"s\":\"t\"," WHERE
+                    ",\"args\":{\"signal\":%d}},\n",
+                    e.tid, ts, e.worker, e.arg);
+            break;
+        }
+    }
+    for (int w = 0; w < workers; ++w) {
+        if (open[w]) {
+            open[w] = false;
+            fprintf(f, "{\"ph\":\"E\"," WHERE "},\n", ts, w);
+        }
+        fprintf(f,
+                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"worker %d\"}},\n",
+                w, w);
+    }
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"args\":{\"name\":\"coco\"}}\n]}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+#else
+
+int coco_trace_flush(const char *path) {
+    (void)path;
+    return -1;
+}
+
+#endif
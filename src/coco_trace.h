@@ -0,0 +1,57 @@
+/**
+ * @file coco_trace.h
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Context-switch tracing, compiled in with COCO_TRACE. Events go to a
+ * lock-free in-memory ring stamped with the cycle counter, and
+ * coco_trace_flush() writes the ring out as Chrome trace-event JSON for
+ * Perfetto or chrome://tracing. Without COCO_TRACE trace_event() compiles to
+ * nothing.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+/**
+ * @brief what happened to a task
+ *
+ */
+enum trace_kind {
+    TRACE_SPAWN,  // Created and queued
+    TRACE_WAKE,   // Runnable again after sleeping or blocking
+    TRACE_RESUME, // Switched to, arg is whether it is a DPC
+    TRACE_YIELD,  // Switched out, still runnable
+    TRACE_SLEEP,  // Switched out into the timer heap
+    TRACE_BLOCK,  // Switched out onto a wait queue
+    TRACE_EXIT,   // Switched out for good, arg is its exit status
+    TRACE_KILL,   // Sent a coco signal, arg is the signal
+};
+
+#ifdef COCO_TRACE
+
+/**
+ * @brief record an event in the ring, overwriting the oldest once it is full.
+ * Safe from any worker at once.
+ *
+ * @param[in] kind what happened
+ * @param[in] tid the task it happened to
+ * @param[in] worker the worker it happened on
+ * @param[in] arg see enum trace_kind
+ */
+void trace_event(enum trace_kind kind, int tid, int worker, int arg);
+
+/**
+ * @brief note when tracing started, to convert the timestamps with
+ *
+ */
+void trace_start();
+
+#else
+
+#define trace_event(kind, tid, worker, arg) ((void)0)
+#define trace_start() ((void)0)
+
+#endif
@@ -0,0 +1,142 @@
+/**
+ * @file pool.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Definitions for task pools in the COCO tiny scheduler/runtime
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "pool.h"
+#include "coco.h"
+#include <stdlib.h>
+
+#define INDEX_MASK ((1u << POOL_INDEX_BITS) - 1)
+#define GEN_MASK (~0ull >> (POOL_INDEX_BITS + 1)) // Keeps handles positive
+
+/**
+ * @brief a worker: run jobs until the pool closes and its queue is empty
+ *
+ * @param[in] arg the pool
+ */
+static void pool_worker(void *arg) {
+    struct coco_pool *p = arg;
+    coco_lock();
+    for (;;) {
+        while (p->head == NULL && !p->closing) {
+            coco_park(&p->idle);
+        }
+        struct coco_pool_job *job = p->head;
+        if (job == NULL) {
+            break;
+        }
+        p->head = job->next;
+        coco_unlock();
+        job->func(job->args);
+        coco_lock();
+        // any handle to it is stale from here on
+        ++job->generation;
+        coco_wake_all(&job->waiters);
+        job->next = p->freeJobs;
+        p->freeJobs = job;
+        coco_wake_one(&p->slots);
+    }
+    coco_unlock();
+    coco_exit(0);
+}
+
+int coco_pool_init(struct coco_pool *p, int workers, int capacity) {
+    if (workers < 1 || capacity < 1 || capacity > (int)INDEX_MASK) {
+        return -1;
+    }
+    p->jobs = calloc(capacity, sizeof *p->jobs);
+    p->tids = calloc(workers, sizeof *p->tids);
+    if (p->jobs == NULL || p->tids == NULL) {
+        free(p->jobs);
+        free(p->tids);
+        return -1;
+    }
+    p->capacity = capacity;
+    p->freeJobs = NULL;
+    for (int i = capacity - 1; i >= 0; --i) {
+        coco_waitq_init(&p->jobs[i].waiters);
+        p->jobs[i].next = p->freeJobs;
+        p->freeJobs = &p->jobs[i];
+    }
+    p->head = p->tail = NULL;
+    coco_waitq_init(&p->idle);
+    coco_waitq_init(&p->slots);
+    p->closing = 0;
+    p->numWorkers = 0;
+    for (int i = 0; i < workers; ++i) {
+        int tid = add_task(pool_worker, p);
+        if (tid == 0) {
+            coco_pool_destroy(p);
+            return -1;
+        }
+        p->tids[p->numWorkers++] = tid;
+    }
+    return 0;
+}
+
+long long coco_pool_submit(struct coco_pool *p, void (*func)(void *),
+                           void *args) {
+    coco_lock();
+    while (p->freeJobs == NULL && !p->closing) {
+        coco_park(&p->slots);
+    }
+    if (p->closing) {
+        coco_unlock();
+        return 0;
+    }
+    struct coco_pool_job *job = p->freeJobs;
+    p->freeJobs = job->next;
+    job->func = func;
+    job->args = args;
+    job->next = NULL;
+    if (p->head == NULL) {
+        p->head = job;
+    } else {
+        p->tail->next = job;
+    }
+    p->tail = job;
+    coco_wake_one(&p->idle);
+    long long handle =
+        (long long)((job->generation & GEN_MASK) << POOL_INDEX_BITS |
+                    (unsigned long long)(job - p->jobs + 1));
+    coco_unlock();
+    return handle;
+}
+
+void coco_pool_wait(struct coco_pool *p, long long handle) {
+    unsigned index = ((unsigned)handle & INDEX_MASK) - 1;
+    unsigned long long generation =
+        (unsigned long long)handle >> POOL_INDEX_BITS;
+    if (index >= (unsigned)p->capacity) {
+        return;
+    }
+    struct coco_pool_job *job = &p->jobs[index];
+    coco_lock();
+    while ((job->generation & GEN_MASK) == generation) {
+        coco_park(&job->waiters);
+    }
+    coco_unlock();
+}
+
+void coco_pool_destroy(struct coco_pool *p) {
+    coco_lock();
+    p->closing = 1;
+    coco_wake_all(&p->idle);
+    coco_wake_all(&p->slots);
+    coco_unlock();
+    for (int i = 0; i < p->numWorkers; ++i) {
+        coco_waitpid(p->tids[i], NULL, COCO_WNOOPT);
+    }
+    free(p->jobs);
+    free(p->tids);
+    p->jobs = NULL;
+    p->tids = NULL;
+    p->numWorkers = 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file pool.h
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Declarations for task pools in the COCO tiny scheduler/runtime. A
+ * pool keeps a few long-lived tasks that run short jobs off a queue, so a
+ * job costs a queue slot instead of a task of its own.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include "coco.h"
+
+/**
+ * @brief a job slot. Its generation is bumped every time a job in it
+ * finishes, which is what a handle to it checks.
+ *
+ */
+struct coco_pool_job {
+    void (*func)(void *);
+    void *args;
+    unsigned long long generation;
+    struct coco_pool_job *next; // In the queue or the free list
+    struct coco_waitq waiters;  // Tasks blocked in coco_pool_wait on it
+};
+
+/**
+ * @brief a task pool, its workers take queued jobs first in first out
+ *
+ */
+struct coco_pool {
+    struct coco_pool_job *jobs; // All the job slots
+    int capacity;
+    struct coco_pool_job *freeJobs;
+    struct coco_pool_job *head, *tail; // Queued jobs
+    struct coco_waitq idle;  // Workers with no job to run
+    struct coco_waitq slots; // Tasks waiting for a free job slot
+    int *tids;               // The workers
+    int numWorkers;
+    int closing; // Whether the workers exit once the queue is empty
+};
+
+/**
+ * @brief initialize a pool and start its workers. Call it from a task.
+ *
+ * @param[in] p the pool
+ * @param[in] workers how many tasks run jobs
+ * @param[in] capacity how many jobs may be queued or running at once, at
+ * most 2^POOL_INDEX_BITS - 1
+ * @return int 0, or -1 if the arguments are out of range or it can't start
+ */
+int coco_pool_init(struct coco_pool *p, int workers, int capacity);
+
+/**
+ * @brief queue a job, waiting for a free slot if the pool is at capacity.
+ * The job runs on one of the workers, may yield and block like any task,
+ * and returns when it is done (it must not coco_exit). A job that submits
+ * to its own pool can deadlock it once it is full.
+ *
+ * @param[in] p the pool
+ * @param[in] func the job
+ * @param[in] args its argument
+ * @return long long a handle to wait on, 0 if the pool is shutting down
+ */
+long long coco_pool_submit(struct coco_pool *p, void (*func)(void *), void *args);
+
+/**
+ * @brief block until a job has finished. Handles needn't be waited on, and
+ * one whose job finished long ago returns right away: a handle only names
+ * another job once 2^(63 - POOL_INDEX_BITS) jobs have run in its slot.
+ *
+ * @param[in] p the pool
+ * @param[in] handle what coco_pool_submit returned
+ */
+void coco_pool_wait(struct coco_pool *p, long long handle);
+
+/**
+ * @brief let the workers finish the queued jobs, then reap them and free
+ * the pool
+ *
+ * @param[in] p the pool
+ */
+void coco_pool_destroy(struct coco_pool *p);
@@ -0,0 +1,353 @@
+/**
+ * @file reactor.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Definitions for coroutine-blocking I/O in the COCO tiny
+ * scheduler/runtime. The epoll engine lives here, the io_uring one in
+ * uring.c.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE ///< accept4
+#include "reactor.h"
+#include "coco.h"
+#include "uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define REACTOR_BATCH 64
+
+/**
+ * @brief what the reactor knows about one descriptor
+ *
+ */
+struct fd_state {
+    struct coco_waitq readers; // tasks parked until it is readable
+    struct coco_waitq writers; // tasks parked until it is writable
+    struct coco_waitq either;  // tasks parked until it is either
+    int numWaiting;            // how many tasks are parked on it
+    bool registered;           // whether it is in the epoll set
+    bool unpollable;           // epoll refused it, treat it as always ready
+};
+
+static int epollFd = -1;
+static struct fd_state *fds;
+static int numFds;
+static int numWaiting; // tasks parked on any descriptor
+static enum coco_io_engine engine;
+static bool engineSet;
+static struct coco_io_stats ioStats;
+
+enum coco_io_engine coco_set_io_engine(enum coco_io_engine wanted) {
+    engineSet = true;
+    engine = wanted == COCO_IO_URING && uring_init() == 0 ? COCO_IO_URING
+                                                          : COCO_IO_EPOLL;
+    return engine;
+}
+
+/**
+ * @brief settle on an engine the first time I/O is done
+ *
+ * @return bool whether io_uring is in use
+ */
+static bool use_uring() {
+    if (!engineSet) {
+#ifdef COCO_IO_URING
+        enum coco_io_engine wanted = COCO_IO_URING;
+#else
+        enum coco_io_engine wanted = COCO_IO_EPOLL;
+#endif
+        char *env = getenv("COCO_IO_ENGINE");
+        if (env != NULL) {
+            wanted = strcmp(env, "uring") == 0 ? COCO_IO_URING : COCO_IO_EPOLL;
+        }
+        coco_set_io_engine(wanted);
+    }
+    return engine == COCO_IO_URING;
+}
+
+void coco_io_stats(struct coco_io_stats *out) {
+    *out = ioStats;
+    out->syscalls += uring_enters();
+}
+
+/**
+ * @brief get the state of a descriptor, growing the table as needed
+ *
+ * @param[in] fd the descriptor
+ * @return struct fd_state* its state or NULL if out of memory
+ */
+static struct fd_state *get_state(int fd) {
+    if (fd >= numFds) {
+        int n = numFds ? numFds : 64;
+        while (n <= fd) {
+            n *= 2;
+        }
+        struct fd_state *grown = realloc(fds, n * sizeof *grown);
+        if (grown == NULL) {
+            return NULL;
+        }
+        for (int i = numFds; i < n; ++i) {
+            grown[i] = (struct fd_state){0};
+            coco_waitq_init(&grown[i].readers);
+            coco_waitq_init(&grown[i].writers);
+            coco_waitq_init(&grown[i].either);
+        }
+        fds = grown;
+        numFds = n;
+    }
+    return &fds[fd];
+}
+
+/**
+ * @brief make a descriptor non-blocking and add it to the epoll set
+ *
+ * @param[in] fd the descriptor
+ * @return struct fd_state* its state or NULL on error
+ */
+static struct fd_state *watch(int fd) {
+    if (fd < 0) {
+        errno = EBADF;
+        return NULL;
+    }
+    struct fd_state *s = get_state(fd);
+    if (s == NULL || s->registered || s->unpollable) {
+        return s;
+    }
+    if (epollFd < 0 && (epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        return NULL;
+    }
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP |
+                                       EPOLLET,
+                             .data.fd = fd};
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        if (errno != EPERM) {
+            return NULL;
+        }
+        s->unpollable = true;
+        return s;
+    }
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0 && !(flags & O_NONBLOCK)) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+    s->registered = true;
+    return s;
+}
+
+static int ready_wait_fd(int fd, int events) {
+    struct fd_state *s = watch(fd);
+    if (s == NULL) {
+        return -1;
+    }
+    if (s->unpollable) {
+        // it can't be watched, let everyone else run before trying again
+        coco_unlock();
+        coco_yield();
+        coco_lock();
+        return 0;
+    }
+    ++s->numWaiting;
+    ++numWaiting;
+    reactor_kick();
+    // a parked task is on one queue, so asking for both gets a queue of its
+    // own that either kind of readiness wakes
+    coco_park((events & COCO_FD_READ) && (events & COCO_FD_WRITE)
+                  ? &s->either
+              : events & COCO_FD_READ ? &s->readers
+                                      : &s->writers);
+    --s->numWaiting;
+    --numWaiting;
+    return 0;
+}
+
+int reactor_fd() {
+    return engine == COCO_IO_URING ? uring_fd()
+                                   : numWaiting > 0 ? epollFd : -1;
+}
+
+int reactor_poll() {
+    if (engine == COCO_IO_URING) {
+        coco_lock();
+        int n = uring_poll();
+        coco_unlock();
+        return n;
+    }
+    if (__atomic_load_n(&numWaiting, __ATOMIC_RELAXED) == 0) {
+        return 0;
+    }
+    struct epoll_event events[REACTOR_BATCH];
+    ++ioStats.syscalls;
+    int n = epoll_wait(epollFd, events, REACTOR_BATCH, 0);
+    coco_lock();
+    for (int i = 0; i < n; ++i) {
+        struct fd_state *s = &fds[events[i].data.fd];
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            coco_wake_all(&s->readers);
+        }
+        if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            coco_wake_all(&s->writers);
+        }
+        coco_wake_all(&s->either);
+    }
+    coco_unlock();
+    return n < 0 ? 0 : n;
+}
+
+static ssize_t ready_read(int fd, void *buf, size_t count) {
+    if (watch(fd) == NULL) {
+        return -1;
+    }
+    for (;;) {
+        ++ioStats.syscalls;
+        ssize_t n = read(fd, buf, count);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            return n;
+        }
+        if (ready_wait_fd(fd, COCO_FD_READ) != 0) {
+            return -1;
+        }
+    }
+}
+
+static ssize_t ready_write(int fd, const void *buf, size_t count) {
+    if (watch(fd) == NULL) {
+        return -1;
+    }
+    size_t done = 0;
+    while (done < count) {
+        ++ioStats.syscalls;
+        ssize_t n = write(fd, (const char *)buf + done, count - done);
+        if (n >= 0) {
+            done += n;
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+        if (ready_wait_fd(fd, COCO_FD_WRITE) != 0) {
+            return -1;
+        }
+    }
+    return done;
+}
+
+static int ready_accept(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    if (watch(fd) == NULL) {
+        return -1;
+    }
+    for (;;) {
+        ++ioStats.syscalls;
+        int conn = accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (conn >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            return conn;
+        }
+        if (ready_wait_fd(fd, COCO_FD_READ) != 0) {
+            return -1;
+        }
+    }
+}
+
+static int ready_connect(int fd, const struct sockaddr *addr,
+                         socklen_t addrlen) {
+    if (watch(fd) == NULL) {
+        return -1;
+    }
+    ++ioStats.syscalls;
+    if (connect(fd, addr, addrlen) == 0) {
+        return 0;
+    }
+    if (errno != EINPROGRESS) {
+        return -1;
+    }
+    if (ready_wait_fd(fd, COCO_FD_WRITE) != 0) {
+        return -1;
+    }
+    int err = 0;
+    socklen_t len = sizeof err;
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+        return -1;
+    }
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+// With more than one worker the reactor's tables are guarded by the runtime
+// lock, which coco_park lets go of while a task waits
+
+int coco_wait_fd(int fd, int events) {
+    coco_lock();
+    int ret =
+        use_uring() ? uring_wait_fd(fd, events) : ready_wait_fd(fd, events);
+    coco_unlock();
+    return ret;
+}
+
+ssize_t coco_read(int fd, void *buf, size_t count) {
+    coco_lock();
+    ++ioStats.ops;
+    ssize_t ret = use_uring() ? uring_read(fd, buf, count)
+                              : ready_read(fd, buf, count);
+    coco_unlock();
+    return ret;
+}
+
+ssize_t coco_write(int fd, const void *buf, size_t count) {
+    coco_lock();
+    ++ioStats.ops;
+    ssize_t ret = use_uring() ? uring_write(fd, buf, count)
+                              : ready_write(fd, buf, count);
+    coco_unlock();
+    return ret;
+}
+
+int coco_accept(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    coco_lock();
+    ++ioStats.ops;
+    int ret = use_uring() ? uring_accept(fd, addr, addrlen)
+                          : ready_accept(fd, addr, addrlen);
+    coco_unlock();
+    return ret;
+}
+
+int coco_connect(int fd, const struct sockaddr *addr, socklen_t addrlen) {
+    coco_lock();
+    ++ioStats.ops;
+    int ret = use_uring() ? uring_connect(fd, addr, addrlen)
+                          : ready_connect(fd, addr, addrlen);
+    coco_unlock();
+    return ret;
+}
+
+int coco_close(int fd) {
+    coco_lock();
+    if (engine == COCO_IO_URING) {
+        uring_cancel_fd(fd);
+    }
+    if (fd >= 0 && fd < numFds) {
+        struct fd_state *s = &fds[fd];
+        if (s->registered) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+        }
+        s->registered = false;
+        s->unpollable = false;
+        // whoever was parked on it finds out from their next read or write
+        coco_wake_all(&s->readers);
+        coco_wake_all(&s->writers);
+        coco_wake_all(&s->either);
+    }
+    coco_unlock();
+    return close(fd);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file reactor.h
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Declarations for coroutine-blocking I/O in the COCO tiny
+ * scheduler/runtime. A task that would block on a file descriptor is parked
+ * until epoll reports the descriptor ready, instead of polling it every
+ * scheduler pass.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#define COCO_FD_READ (1 << 0)
+#define COCO_FD_WRITE (1 << 1)
+
+/**
+ * @brief how blocking I/O is carried out
+ *
+ */
+enum coco_io_engine {
+    COCO_IO_EPOLL, // try the syscall, park on EAGAIN until epoll says ready
+    COCO_IO_URING, // queue it on an io_uring, submitted once per pass
+};
+
+/**
+ * @brief I/O counters since the program started
+ *
+ */
+struct coco_io_stats {
+    unsigned long long ops;      // coco_read/write/accept/connect calls
+    unsigned long long syscalls; // syscalls the engine made for them
+};
+
+/**
+ * @brief pick the I/O engine. Call it before the first I/O; until then the
+ * COCO_IO_ENGINE environment variable ("epoll" or "uring") or the
+ * COCO_IO_URING build option decide. Falls back to epoll when io_uring is
+ * unavailable.
+ *
+ * @param[in] engine the engine wanted
+ * @return enum coco_io_engine the engine in use
+ */
+enum coco_io_engine coco_set_io_engine(enum coco_io_engine engine);
+
+/**
+ * @brief get the I/O counters
+ *
+ * @param[out] out where to put them
+ */
+void coco_io_stats(struct coco_io_stats *out);
+
+/**
+ * @brief park the running task until a file descriptor is ready. The
+ * descriptor is switched to non-blocking mode the first time it is used.
+ * Descriptors epoll can't watch (regular files) just yield once.
+ *
+ * @param[in] fd the descriptor
+ * @param[in] events COCO_FD_READ and/or COCO_FD_WRITE; with both it wakes on
+ * whichever readiness comes first
+ * @return 0 when ready, -1 if the descriptor could not be watched
+ */
+int coco_wait_fd(int fd, int events);
+
+/**
+ * @brief read(2) that parks the task instead of blocking the scheduler
+ *
+ * @return the number of bytes read, 0 at end of file, -1 and errno on error
+ */
+ssize_t coco_read(int fd, void *buf, size_t count);
+
+/**
+ * @brief write(2) that parks the task until all of buf is written
+ *
+ * @return count, or -1 and errno on error
+ */
+ssize_t coco_write(int fd, const void *buf, size_t count);
+
+/**
+ * @brief accept(2) that parks the task until a connection arrives. The new
+ * socket is non-blocking and close-on-exec.
+ *
+ * @return the connected socket, or -1 and errno on error
+ */
+int coco_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief connect(2) that parks the task until the connection is made
+ *
+ * @return 0, or -1 and errno on error
+ */
+int coco_connect(int fd, const struct sockaddr *addr, socklen_t addrlen);
+
+/**
+ * @brief stop watching a descriptor, wake anything parked on it and close it
+ *
+ * @return what close(2) returned
+ */
+int coco_close(int fd);
+
+/**
+ * @brief the epoll descriptor the scheduler sleeps on while idle, -1 if no
+ * task is waiting on I/O
+ *
+ */
+int reactor_fd();
+
+/**
+ * @brief wake every task whose descriptor became ready, without blocking.
+ * Called by the scheduler once per pass.
+ *
+ * @return the number of ready events
+ */
+int reactor_poll();
+
+/**
+ * @brief make sure the thread that polls the reactor looks at it again soon,
+ * called before a task parks on I/O. Defined by the scheduler; only does
+ * anything with more than one worker.
+ *
+ */
+void reactor_kick();
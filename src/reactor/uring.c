@@ -0,0 +1,394 @@
+/**
+ * @file uring.c
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Definitions for the io_uring engine of the COCO tiny
+ * scheduler/runtime. Tasks queue submissions and park; the scheduler submits
+ * the whole batch with one io_uring_enter per pass and wakes each task when
+ * its completion is reaped.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE ///< POLLRDHUP
+#include "uring.h"
+#include "coco.h"
+#include "reactor.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_ENTRIES 256
+#define URING_MAX_IO (1 << 16) // largest single read or write
+
+/**
+ * @brief one operation in flight. These live off the task stack, since a
+ * copying task's stack is reused by others while it is parked, and the
+ * kernel writes into them then.
+ *
+ */
+struct uring_req {
+    struct uring_req *nextFree;
+    struct coco_waitq waiter;       // the task that submitted it
+    int res;                        // the completion result
+    bool done;                      // whether res is valid
+    char *buf;                      // bounce buffer for reads and writes
+    size_t cap;                     // size of buf
+    struct sockaddr_storage addr;   // address for accept and connect
+    socklen_t addrlen;              // its length
+};
+
+static int ringFd = -1;
+static unsigned *sqHead, *sqTail, *sqMask, *sqArray, *sqFlags;
+static unsigned *cqHead, *cqTail, *cqMask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static unsigned sqEntries;
+static unsigned queued;   // submissions not yet handed to the kernel
+static unsigned inFlight; // submissions without a completion
+static unsigned long long enters;
+static struct uring_req *freeReqs;
+
+int uring_init() {
+    if (ringFd >= 0) {
+        return 0;
+    }
+    struct io_uring_params p = {0};
+    int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && cqSize > sqSize) {
+        sqSize = cqSize;
+    }
+    char *sq = mmap(NULL, sqSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    char *cq = sq;
+    if (sq != MAP_FAILED && !single) {
+        cq = mmap(NULL, cqSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    void *s = MAP_FAILED;
+    if (sq != MAP_FAILED && cq != MAP_FAILED) {
+        s = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                 IORING_OFF_SQES);
+    }
+    if (s == MAP_FAILED) {
+        // the process is stuck with the mappings, but not with the ring
+        close(fd);
+        return -1;
+    }
+    sqHead = (unsigned *)(sq + p.sq_off.head);
+    sqTail = (unsigned *)(sq + p.sq_off.tail);
+    sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    sqArray = (unsigned *)(sq + p.sq_off.array);
+    sqFlags = (unsigned *)(sq + p.sq_off.flags);
+    cqHead = (unsigned *)(cq + p.cq_off.head);
+    cqTail = (unsigned *)(cq + p.cq_off.tail);
+    cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    sqes = s;
+    sqEntries = p.sq_entries;
+    ringFd = fd;
+    return 0;
+}
+
+/**
+ * @brief hand every queued submission to the kernel
+ *
+ */
+static void submit() {
+    while (queued > 0) {
+        ++enters;
+        int n = syscall(__NR_io_uring_enter, ringFd, queued, 0, 0, NULL, 0);
+        if (n <= 0) {
+            // EBUSY/EAGAIN: completions need reaping first, try next pass
+            return;
+        }
+        queued -= n;
+    }
+}
+
+/**
+ * @brief take every completion off the completion queue and wake the tasks
+ * waiting for them. Completions that found it full wait in the kernel until
+ * asked for, and nobody else asks.
+ *
+ * @return int how many completions there were
+ */
+static int reap() {
+    int n = 0;
+    for (;;) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head, ++n) {
+            struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+            struct uring_req *r =
+                (struct uring_req *)(uintptr_t)cqe->user_data;
+            if (r != NULL) {
+                r->res = cqe->res;
+                r->done = true;
+                coco_wake_one(&r->waiter);
+            }
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        if (!(__atomic_load_n(sqFlags, __ATOMIC_ACQUIRE) &
+              IORING_SQ_CQ_OVERFLOW)) {
+            return n;
+        }
+        ++enters;
+        if (syscall(__NR_io_uring_enter, ringFd, 0, 0,
+                    IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+            return n;
+        }
+    }
+}
+
+/**
+ * @brief claim the next submission slot, flushing the queue when it is full.
+ * If the kernel won't take the queue because completions are backed up, they
+ * are reaped here, and if there are none yet the task lets the others run
+ * before it tries again.
+ *
+ * @param[in] op the opcode
+ * @param[in] fd the descriptor it works on
+ * @param[in] r the request to complete, NULL if nobody waits for it
+ * @return struct io_uring_sqe* the zeroed submission to fill in
+ */
+static struct io_uring_sqe *get_sqe(int op, int fd, struct uring_req *r) {
+    while (*sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        submit();
+        if (*sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries &&
+            reap() == 0) {
+            // others may fill the queue meanwhile, so look at it afresh
+            coco_unlock();
+            coco_yield();
+            coco_lock();
+        }
+    }
+    unsigned tail = *sqTail;
+    unsigned i = tail & *sqMask;
+    struct io_uring_sqe *sqe = &sqes[i];
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->user_data = (uintptr_t)r;
+    sqArray[i] = i;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++queued;
+    return sqe;
+}
+
+/**
+ * @brief get a request with a bounce buffer of at least size bytes
+ *
+ * @return struct uring_req* the request or NULL if out of memory
+ */
+static struct uring_req *get_req(size_t size) {
+    struct uring_req *r = freeReqs;
+    if (r != NULL) {
+        freeReqs = r->nextFree;
+    } else if ((r = calloc(1, sizeof *r)) == NULL) {
+        return NULL;
+    }
+    if (r->cap < size) {
+        char *buf = realloc(r->buf, size);
+        if (buf == NULL) {
+            r->nextFree = freeReqs;
+            freeReqs = r;
+            return NULL;
+        }
+        r->buf = buf;
+        r->cap = size;
+    }
+    coco_waitq_init(&r->waiter);
+    r->done = false;
+    return r;
+}
+
+static void put_req(struct uring_req *r) {
+    r->nextFree = freeReqs;
+    freeReqs = r;
+}
+
+/**
+ * @brief park the task until its submission completes
+ *
+ * @return int the result, negated errno on failure
+ */
+static int await(struct uring_req *r) {
+    ++inFlight;
+    reactor_kick(); // its entry is only submitted by the reactor's next pass
+    while (!r->done) {
+        coco_park(&r->waiter);
+    }
+    --inFlight;
+    return r->res;
+}
+
+/**
+ * @brief turn a completion result into the libc convention
+ *
+ */
+static int result(int res) {
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
+
+int uring_wait_fd(int fd, int events) {
+    struct uring_req *r = get_req(0);
+    if (r == NULL) {
+        return -1;
+    }
+    struct io_uring_sqe *sqe = get_sqe(IORING_OP_POLL_ADD, fd, r);
+    sqe->poll32_events = (events & COCO_FD_READ ? POLLIN | POLLRDHUP : 0) |
+                         (events & COCO_FD_WRITE ? POLLOUT : 0);
+    int res = await(r);
+    put_req(r);
+    return res < 0 ? result(res) : 0;
+}
+
+ssize_t uring_read(int fd, void *buf, size_t count) {
+    if (count > URING_MAX_IO) {
+        count = URING_MAX_IO;
+    }
+    struct uring_req *r = get_req(count);
+    if (r == NULL) {
+        return -1;
+    }
+    int res;
+    do {
+        r->done = false;
+        struct io_uring_sqe *sqe = get_sqe(IORING_OP_READ, fd, r);
+        sqe->addr = (uintptr_t)r->buf;
+        sqe->len = count;
+        sqe->off = (uint64_t)-1; // the current file position
+        res = await(r);
+    } while (res == -EAGAIN && uring_wait_fd(fd, COCO_FD_READ) == 0);
+    if (res > 0) {
+        memcpy(buf, r->buf, res);
+    }
+    put_req(r);
+    return result(res);
+}
+
+ssize_t uring_write(int fd, const void *buf, size_t count) {
+    size_t chunk = count < URING_MAX_IO ? count : URING_MAX_IO;
+    struct uring_req *r = get_req(chunk);
+    if (r == NULL) {
+        return -1;
+    }
+    size_t done = 0;
+    while (done < count) {
+        size_t len = count - done < chunk ? count - done : chunk;
+        memcpy(r->buf, (const char *)buf + done, len);
+        r->done = false;
+        struct io_uring_sqe *sqe = get_sqe(IORING_OP_WRITE, fd, r);
+        sqe->addr = (uintptr_t)r->buf;
+        sqe->len = len;
+        sqe->off = (uint64_t)-1;
+        int res = await(r);
+        if (res == -EAGAIN && uring_wait_fd(fd, COCO_FD_WRITE) == 0) {
+            continue;
+        }
+        if (res < 0) {
+            put_req(r);
+            return result(res);
+        }
+        done += res;
+    }
+    put_req(r);
+    return done;
+}
+
+int uring_accept(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    struct uring_req *r = get_req(0);
+    if (r == NULL) {
+        return -1;
+    }
+    int res;
+    do {
+        r->done = false;
+        r->addrlen = sizeof r->addr;
+        struct io_uring_sqe *sqe = get_sqe(IORING_OP_ACCEPT, fd, r);
+        sqe->addr = (uintptr_t)&r->addr;
+        sqe->addr2 = (uintptr_t)&r->addrlen;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        res = await(r);
+    } while (res == -EAGAIN && uring_wait_fd(fd, COCO_FD_READ) == 0);
+    if (res >= 0 && addr != NULL && addrlen != NULL) {
+        memcpy(addr, &r->addr, r->addrlen < *addrlen ? r->addrlen : *addrlen);
+        *addrlen = r->addrlen;
+    }
+    put_req(r);
+    return result(res);
+}
+
+int uring_connect(int fd, const struct sockaddr *addr, socklen_t addrlen) {
+    if (addrlen > sizeof(struct sockaddr_storage)) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct uring_req *r = get_req(0);
+    if (r == NULL) {
+        return -1;
+    }
+    memcpy(&r->addr, addr, addrlen);
+    struct io_uring_sqe *sqe = get_sqe(IORING_OP_CONNECT, fd, r);
+    sqe->addr = (uintptr_t)&r->addr;
+    sqe->off = addrlen;
+    int res = await(r);
+    put_req(r);
+    if (res != -EINPROGRESS && res != -EAGAIN) {
+        return result(res);
+    }
+    // a non-blocking socket connects in the background
+    if (uring_wait_fd(fd, COCO_FD_WRITE) != 0) {
+        return -1;
+    }
+    int err = 0;
+    socklen_t len = sizeof err;
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+        return -1;
+    }
+    return result(-err);
+}
+
+void uring_cancel_fd(int fd) {
+    if (ringFd < 0 || inFlight == 0) {
+        return;
+    }
+    struct io_uring_sqe *sqe = get_sqe(IORING_OP_ASYNC_CANCEL, fd, NULL);
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    // the descriptor has to still be open when the kernel looks it up
+    submit();
+}
+
+int uring_fd() { return inFlight > 0 ? ringFd : -1; }
+
+int uring_poll() {
+    if (ringFd < 0 || queued + inFlight == 0) {
+        return 0;
+    }
+    submit();
+    return reap();
+}
+
+unsigned long long uring_enters() { return enters; }
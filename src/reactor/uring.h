@@ -0,0 +1,56 @@
+/**
+ * @file uring.h
+ * @author Eric Breyer (ericbreyer.com)
+ * @brief Declarations for the io_uring engine behind the coroutine-blocking
+ * I/O calls of the COCO tiny scheduler/runtime. Only reactor.c uses these.
+ * @version 0.2
+ * @date 2024-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/**
+ * @brief set up the ring
+ *
+ * @return 0 on success, -1 if io_uring is unavailable
+ */
+int uring_init();
+
+int uring_wait_fd(int fd, int events);
+ssize_t uring_read(int fd, void *buf, size_t count);
+ssize_t uring_write(int fd, const void *buf, size_t count);
+int uring_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+int uring_connect(int fd, const struct sockaddr *addr, socklen_t addrlen);
+
+/**
+ * @brief cancel everything in flight on a descriptor before it is closed
+ *
+ */
+void uring_cancel_fd(int fd);
+
+/**
+ * @brief the ring descriptor, -1 if nothing is in flight
+ *
+ */
+int uring_fd();
+
+/**
+ * @brief submit everything queued since the last pass in one io_uring_enter
+ * and resume the tasks whose operations completed
+ *
+ * @return the number of completions
+ */
+int uring_poll();
+
+/**
+ * @brief how many io_uring_enter calls were made
+ *
+ */
+unsigned long long uring_enters();
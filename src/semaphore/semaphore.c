@@ -2,14 +2,20 @@
 #include "semaphore.h"
 
 void coco_sem_init(coco_sem *sem, int value) {
-    *sem = value;
+    sem->value = value;
+    coco_waitq_init(&sem->waiters);
 }
 void coco_sem_wait(coco_sem *sem) {
-    while (*sem <= 0) {
-        coco_yield();
+    coco_lock_on(sem);
+    while (sem->value <= 0) {
+        coco_park_on(&sem->waiters, sem);
     }
-    --*sem;
+    --sem->value;
+    coco_unlock_on(sem);
 }
 void coco_sem_post(coco_sem *sem) {
-    ++*sem;
+    coco_lock_on(sem);
+    ++sem->value;
+    coco_wake_one(&sem->waiters);
+    coco_unlock_on(sem);
 }
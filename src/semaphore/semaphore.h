@@ -1,4 +1,15 @@
-typedef unsigned int coco_sem;
+#pragma once
+
+#include "coco.h"
+
+/**
+ * @brief a counting semaphore, tasks that find it at zero park on it
+ *
+ */
+typedef struct {
+    int value;
+    struct coco_waitq waiters;
+} coco_sem;
 
 void coco_sem_init(coco_sem *sem, int value);
 void coco_sem_wait(coco_sem *sem);
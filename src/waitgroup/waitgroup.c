@@ -13,21 +13,33 @@
 #include "waitgroup.h"
 #include "coco.h"
 
-void init_wg(struct waitGroup *wg) { wg->counter = 0; }
+void init_wg(struct waitGroup *wg) {
+    wg->counter = 0;
+    coco_waitq_init(&wg->waiters);
+}
 
 void wg_add(struct waitGroup *wg, unsigned int numTasks) {
+    coco_lock_on(wg);
     wg->counter += numTasks;
+    coco_unlock_on(wg);
 }
 
-void wg_done(struct waitGroup *wg) { --wg->counter; }
+void wg_done(struct waitGroup *wg) {
+    coco_lock_on(wg);
+    if (--wg->counter == 0) {
+        coco_wake_all(&wg->waiters);
+    }
+    coco_unlock_on(wg);
+}
 
-int wg_check(struct waitGroup *wg) { return wg->counter == 0; }
+int wg_check(struct waitGroup *wg) {
+    return __atomic_load_n(&wg->counter, __ATOMIC_RELAXED) == 0;
+}
 
 void wg_wait(struct waitGroup *wg) {
-    for (;;) {
-        if (wg->counter == 0) {
-            return;
-        }
-        coco_yield();
+    coco_lock_on(wg);
+    while (wg->counter != 0) {
+        coco_park_on(&wg->waiters, wg);
     }
+    coco_unlock_on(wg);
 }
\ No newline at end of file
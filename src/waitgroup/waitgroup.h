@@ -12,13 +12,17 @@
 
 #pragma once
 
+#include "coco.h"
+
 /**
  * @brief a wait group is really just an atomic counter, since this is not
- * multithreaded or preemptive, everything is already atomic.
+ * multithreaded or preemptive, everything is already atomic. Tasks waiting
+ * for it to hit zero park on it.
  *
  */
 struct waitGroup {
     unsigned int counter;
+    struct coco_waitq waiters;
 };
 
 /**
@@ -52,7 +56,7 @@ void wg_done(struct waitGroup *wg);
 int wg_check(struct waitGroup *wg);
 
 /**
- * @brief yield until a waitgroup's count is 0
+ * @brief block until a waitgroup's count is 0
  *
  * @param[in] wg
  */